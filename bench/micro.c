@@ -0,0 +1,276 @@
+// micro benchmarks of the hot primitives, scalar baselines next to the
+// SIMD variants. One json object per line on stdout so results can be
+// collected across commits. Run with `make bench-micro`.
+#define HEXING_NO_MAIN
+#include "../main.c"
+
+#define MICRO_BUF  (1 << 20)
+#define MICRO_RUNS 5
+#define MICRO_MIN  50000000  // ns per run, at least
+
+static unsigned char *src;
+static char *txt, *dst;
+static volatile long sink;  // keeps results alive
+
+// baselines: what the code did before the kernels (or the obvious loop)
+
+static void toasciihex(unsigned char s, char *d) { snprintf(d, 3, "%02X", s); }
+static char toprintable(char s) { return (s < 0x20 || s > 0x7e) ? '.' : s; }
+
+static void hex_snprintf(void)
+{
+  for (long i = 0; i < MICRO_BUF; i++)
+    toasciihex(src[i], dst + i*2);
+}
+
+static void hex_lut(void) { fmt_hex_lut(src, dst, MICRO_BUF); }
+static void hex_simd(void) { fmt_hex(src, dst, MICRO_BUF); }
+
+static void printable_branch(void)
+{
+  for (long i = 0; i < MICRO_BUF; i++)
+    dst[i] = toprintable(src[i]);
+}
+
+static void printable_lut(void) { fmt_printable_lut(src, dst, MICRO_BUF); }
+static void printable_simd(void) { fmt_printable(src, dst, MICRO_BUF); }
+
+static void row_split(void) // rows of 16 as show_content() formats them
+{
+  for (long i = 0; i < MICRO_BUF; i += 16) {
+    fmt_hex(src + i, dst + (i & 0xffff) * 3, 16);
+    fmt_printable(src + i, dst + (i & 0xffff) * 3 + 32, 16);
+  }
+}
+
+static void row_fused(void)
+{
+  for (long i = 0; i < MICRO_BUF; i += 16)
+    fmt_row(src + i, 16, dst + (i & 0xffff) * 3, dst + (i & 0xffff) * 3 + 32);
+}
+
+static void unhex_lut(void)
+{
+  sink += fmt_unhex_lut(txt, (unsigned char *)dst, MICRO_BUF/2);
+}
+
+static void unhex_simd(void)
+{
+  sink += fmt_unhex(txt, (unsigned char *)dst, MICRO_BUF/2);
+}
+
+static void offset_snprintf(void) // one per row of 16 bytes
+{
+  for (long i = 0; i < MICRO_BUF; i += 16)
+    off_toasciihex(i, dst + i/4);
+}
+
+static void offset_fmt(void)
+{
+  for (long i = 0; i < MICRO_BUF; i += 16)
+    fmt_offset(i, dst + i/4, 4);
+}
+
+static void escape(void) // copy_bytes() without the clipboard, 4 at a time
+{
+  for (long i = 0; i < MICRO_BUF; i += 4)
+    escape_bytes(src + i, 4, dst + (i & 0xffff) * 4);
+}
+
+static void magic_find(void) // every 4K of random data as a file
+{
+  for (long i = 0; i + 4096 <= MICRO_BUF; i += 4096)
+    sink += find_magic((char *)src + i, 4096).hdr_len;
+}
+
+static void search_naive(void)
+{
+  static const unsigned char pat[] = "\x7f\x45\x4c\x46\x02";
+  for (long i = 0; i + 5 <= MICRO_BUF; i++)
+    if (src[i] == pat[0] && memcmp(src + i, pat, 5) == 0) {
+      sink += i;
+      break;
+    }
+}
+
+static void search_memmem(void)
+{
+  sink += (long)memmem(src, MICRO_BUF, "\x7f\x45\x4c\x46\x02", 5);
+}
+
+static void hilite_spans(void) // 100k spans over the buffer, once
+{
+  if (hl.n > 0) return;
+  for (long i = 0; i < 100000; i++) {
+    long at = (long)src[i*8 % MICRO_BUF] << 12 | src[i*8 % MICRO_BUF + 1] << 4;
+    hl_add(at, at + 1 + src[i*8 % MICRO_BUF + 2], HL_FIND, 0, 0);
+  }
+}
+
+static void hilite_scan(void) // a window of 256 bytes every 4K
+{
+  hilite_spans();
+  for (long off = 0; off < MICRO_BUF; off += 4096)
+    for (long i = 0; i < hl.n; i++)
+      sink += (hl.s[i].start < off + 256 && off < hl.s[i].end);
+}
+
+static void hilite_tree(void)
+{
+  hilite_spans();
+  for (long off = 0; off < MICRO_BUF; off += 4096) {
+    hl_window(off, 256);
+    sink += hl.nvis;
+  }
+}
+
+static void crc32_bytewise(void)
+{
+  uint32_t c = ~0u;
+  pthread_once(&crc32_once, crc32_init);
+  for (long i = 0; i < MICRO_BUF; i++)
+    c = crc32_table[0][(c ^ src[i]) & 0xff] ^ (c >> 8);
+  sink += c;
+}
+
+static void crc32_slice8(void) { sink += crc32_update(0, src, MICRO_BUF); }
+
+/* one byte changed in the middle: the crc again against fixing it up */
+static void crc32_rehash(void)
+{
+  src[MICRO_BUF/2]++;
+  sink += crc32_update(0, src, MICRO_BUF);
+}
+
+static void crc32_fixup(void)
+{
+  unsigned char old = src[MICRO_BUF/2]++;
+  sink += crc32_delta(old, src[MICRO_BUF/2], MICRO_BUF/2 - 1);
+}
+
+static void strings_bytewise(void) // ascii runs only, as strings(1) does
+{
+  long run = 0, n = 0;
+  for (long i = 0; i < MICRO_BUF; i++) {
+    if (str_print(src[i])) {
+      run++;
+    } else {
+      n += (run >= STR_MIN);
+      run = 0;
+    }
+  }
+  sink += n;
+}
+
+static void strings_masks(void) // ascii, utf-8 and utf-16 at once
+{
+  strjob s = { .mem = src, .size = MICRO_BUF };
+  strlist l = { NULL };
+  str_scan(&s, &l, 0, MICRO_BUF);
+  sink += l.n;
+  free(l.h);
+}
+
+static void regex_run(const char *pat) // the DFA of regex.h, one thread
+{
+  rejob r = { .mem = src, .size = MICRO_BUF, .best = LONG_MAX };
+  const char *err;
+  if ((r.re = re_new(pat, strlen(pat), &err)) == NULL) return;
+  re_chunk(&r.j, 0);
+  sink += r.best;
+  re_free(r.re);
+}
+
+static void regex_literal(void) { regex_run("\\x7fELF\\x02"); }
+static void regex_class(void) { regex_run("[A-Z][a-z]{6}[0-9]{3}"); }
+
+static void ngram_grams(void) // the buckets of each 64K block of text
+{
+  static uint64_t seen[NG_HASH / 64];
+  static uint16_t got[NG_CAP];
+  for (long b = 0; b + NG_BLOCK <= MICRO_BUF; b += NG_BLOCK) {
+    int n = ng_grams((unsigned char *)txt, b, b + NG_BLOCK, seen, got, 0);
+    for (int i = 0; i < (n == -1 ? NG_CAP : n); i++)
+      seen[got[i] >> 6] = 0;
+    sink += n;
+  }
+}
+
+static void values_run(int simd) // a timestamp as 8 integer and float types
+{
+  static valjob v;
+  static const char q[] = "1700000000~86400 32 64 i f";
+  if (v.nenc == 0) val_parse(&v, q, sizeof(q) - 1);
+  for (long p = 0; p < MICRO_BUF; p += 64)
+    sink += (simd ? val_block(&v, src + p, MICRO_BUF - p) :
+      val_block_scalar(&v, src + p, MICRO_BUF - p)) != 0;
+}
+
+static void values_scalar(void) { values_run(0); }
+static void values_simd(void) { values_run(1); }
+
+static const struct {
+  const char *name, *variant;
+  void (*fn)(void);
+} micros[] = {
+  { "hex",       "snprintf", hex_snprintf },
+  { "hex",       "lut",      hex_lut },
+  { "hex",       "simd",     hex_simd },
+  { "printable", "branch",   printable_branch },
+  { "printable", "lut",      printable_lut },
+  { "printable", "simd",     printable_simd },
+  { "row",       "split",    row_split },
+  { "row",       "fused",    row_fused },
+  { "unhex",     "lut",      unhex_lut },
+  { "unhex",     "simd",     unhex_simd },
+  { "offset",    "snprintf", offset_snprintf },
+  { "offset",    "lut",      offset_fmt },
+  { "escape",    "lut",      escape },
+  { "magic",     "scalar",   magic_find },
+  { "search",    "naive",    search_naive },
+  { "search",    "memmem",   search_memmem },
+  { "hilite",    "scan",     hilite_scan },
+  { "hilite",    "tree",     hilite_tree },
+  { "crc32",     "bytewise", crc32_bytewise },
+  { "crc32",     "slice8",   crc32_slice8 },
+  { "crc32edit", "rehash",   crc32_rehash },
+  { "crc32edit", "delta",    crc32_fixup },
+  { "strings",   "bytewise", strings_bytewise },
+  { "strings",   "masks",    strings_masks },
+  { "regex",     "literal",  regex_literal },
+  { "regex",     "class",    regex_class },
+  { "ngram",     "grams",    ngram_grams },
+  { "values",    "scalar",   values_scalar },
+  { "values",    "simd",     values_simd },
+};
+
+int main(int argc, char **argv)
+{
+  const char *commit = getenv("HEXING_COMMIT");
+
+  src = malloc(MICRO_BUF);
+  txt = malloc(MICRO_BUF * 2);
+  dst = malloc(MICRO_BUF * 4 + 16);
+  srand(1);
+  for (long i = 0; i < MICRO_BUF; i++) src[i] = rand();
+  fmt_hex(src, txt, MICRO_BUF);
+
+  for (int m = 0; m < sizeof(micros)/sizeof(*micros); m++) {
+    double best = 1e300;
+    if (argc > 1 && strcmp(argv[1], micros[m].name) != 0) continue;
+    for (int r = 0; r < MICRO_RUNS; r++) { // best of, ns per buffer
+      long iters = 0;
+      uint64_t t0 = prof_now(), t;
+      do {
+        micros[m].fn();
+        iters++;
+      } while ((t = prof_now() - t0) < MICRO_MIN);
+      if ((double)t / iters < best) best = (double)t / iters;
+    }
+    printf("{\"bench\":\"%s\",\"variant\":\"%s\",\"commit\":\"%s\","
+      "\"bytes\":%d,\"ns\":%.0f,\"mb_s\":%.1f}\n", micros[m].name,
+      micros[m].variant, commit ? commit : "", MICRO_BUF, best,
+      MICRO_BUF / best * 1e3);
+  }
+  return 0;
+}
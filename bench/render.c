@@ -0,0 +1,144 @@
+// headless render benchmark: drives show_content() through scripted
+// navigation on generated files, with SDL's dummy video driver and the
+// software renderer. Run with `make bench`.
+#define HEXING_NO_MAIN
+#include "../main.c"
+
+#define BENCH_FRAMES 2000
+
+// every allocation of the process, SDL and freetype included
+static long allocs;
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t n)
+{
+  __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(n);
+}
+void *calloc(size_t n, size_t m)
+{
+  __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(n, m);
+}
+void *realloc(void *p, size_t n)
+{
+  __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(p, n);
+}
+
+enum {
+  SCRIPT_PAGEDOWN = 0,  // page down from the start of the file
+  SCRIPT_GOTO,          // random offsets through go()
+  SCRIPT_SWEEP,         // cursor to the right across the window
+  SCRIPTS
+};
+
+static const char *script_names[SCRIPTS] = { "pagedown", "goto", "sweep" };
+
+static void press(SDL_Keycode k)
+{
+  SDL_Event e;
+
+  memset(&e, 0, sizeof(e));
+  e.type = SDL_KEYDOWN;
+  e.key.keysym.sym = k;
+  handle_event(&e);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* random data, large files are sparse with a random page every megabyte */
+static char *make_file(long size)
+{
+  static char path[64];
+  char page[4096];
+  long step = (size > (64L << 20) ? 1L << 20 : sizeof(page));
+  int fd;
+
+  snprintf(path, sizeof(path), "/tmp/hexing-bench-XXXXXX");
+  if ((fd = mkstemp(path)) == -1 || ftruncate(fd, size) == -1) {
+    perror("bench file");
+    exit(1);
+  }
+  for (long off = 0; off < size; off += step) {
+    long n = (size - off < sizeof(page) ? size - off : sizeof(page));
+    for (int i = 0; i < n; i++) page[i] = rand();
+    if (pwrite(fd, page, n, off) != n) {
+      perror("bench file");
+      exit(1);
+    }
+  }
+  close(fd);
+  return path;
+}
+
+static void run_script(int script, const char *label)
+{
+  static double ms[BENCH_FRAMES];
+  int frames = 0;
+  long a0 = allocs;
+  uint64_t t0 = prof_now();
+
+  doc.fpos = 0; win.curpos = 0;
+  for (; frames < BENCH_FRAMES; frames++) {
+    uint64_t t = prof_now();
+    switch (script) {
+      case SCRIPT_PAGEDOWN:
+        if (doc.fpos + win.amount >= doc.fsize) goto done;
+        press(SDLK_PAGEDOWN);
+        break;
+      case SCRIPT_GOTO:
+        go(((long)rand() << 16 ^ rand()) % doc.fsize);
+        break;
+      case SCRIPT_SWEEP:
+        press(SDLK_RIGHT);
+        break;
+    }
+    prof_frame_begin();
+    show_content();
+    prof_frame_end();
+    ms[frames] = (prof_now() - t) / 1e6;
+  }
+done:
+  if (frames == 0) frames = 1, ms[0] = 0;
+  double total = (prof_now() - t0) / 1e9;
+  qsort(ms, frames, sizeof(double), cmp_double);
+  printf("%-8s %-9s %7d %9.1f %8.3f %8.3f %9.1f\n", label,
+    script_names[script], frames, frames / total, ms[frames/2],
+    ms[(int)(frames * 0.99)], (double)(allocs - a0) / frames);
+}
+
+int main(int argc, char **argv)
+{
+  static const long sizes[] = { 4L << 10, 1L << 20, 64L << 20, 1L << 30 };
+  static const char *labels[] = { "4K", "1M", "64M", "1G" };
+
+  setenv("SDL_VIDEODRIVER", "dummy", 0);
+  SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+  SDL_SetHint(SDL_HINT_RENDER_VSYNC, "0");
+  srand(1);
+  win.colsize = 4*win.cols;
+  win.amount  = win.colsize*win.rows;
+  init_window();
+  doc.ro = 1;
+
+  printf("%-8s %-9s %7s %9s %8s %8s %9s\n", "size", "script", "frames",
+    "fps", "p50 ms", "p99 ms", "allocs/f");
+  for (int i = 0; i < sizeof(sizes)/sizeof(*sizes); i++) {
+    char *path = make_file(sizes[i]);
+    doc.filepath = path;
+    init_content();
+    for (int s = 0; s < SCRIPTS; s++)
+      run_script(s, labels[i]);
+    munmap(doc.fdmem, doc.fsize);
+    close(doc.fd);
+    unlink(path);
+  }
+  return 0;
+}
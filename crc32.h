@@ -0,0 +1,79 @@
+// crc-32 (ieee 802.3, same values as zlib), slicing by 8 bytes at a time.
+// The crc of a change is independent of the bytes that didn't change, so
+// fixing one up after an edit only costs a multiplication per changed byte
+// by what the bytes after it do (x^8n, see crc32_zeros()).
+#include <stdint.h>
+#include <pthread.h>
+
+static uint32_t crc32_table[8][256];
+static uint32_t crc32_x2n[32];  // x^(2^n) modulo the polynomial
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+/* a*b modulo the polynomial, bit-reflected like the crc itself */
+static uint32_t crc32_mult(uint32_t a, uint32_t b)
+{
+  uint32_t m = 1u << 31, p = 0;
+
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? 0xedb88320 ^ (b >> 1) : b >> 1;
+  }
+  return p;
+}
+
+static void crc32_init(void)
+{
+  for (int i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    crc32_table[0][i] = c;
+  }
+  for (int i = 0; i < 256; i++)
+    for (int t = 1; t < 8; t++)
+      crc32_table[t][i] = (crc32_table[t-1][i] >> 8) ^
+        crc32_table[0][crc32_table[t-1][i] & 0xff];
+  crc32_x2n[0] = 1u << 30; // x
+  for (int n = 1; n < 32; n++)
+    crc32_x2n[n] = crc32_mult(crc32_x2n[n-1], crc32_x2n[n-1]);
+}
+
+/* start with crc = 0, feed the result back to continue */
+static uint32_t crc32_update(uint32_t crc, const unsigned char *s, long n)
+{
+  pthread_once(&crc32_once, crc32_init);
+  crc = ~crc;
+  for (; n >= 8; n -= 8, s += 8) {
+    uint32_t a = crc ^ (s[0] | s[1] << 8 | s[2] << 16 | (uint32_t)s[3] << 24);
+    crc = crc32_table[7][a & 0xff] ^ crc32_table[6][(a >> 8) & 0xff] ^
+      crc32_table[5][(a >> 16) & 0xff] ^ crc32_table[4][a >> 24] ^
+      crc32_table[3][s[4]] ^ crc32_table[2][s[5]] ^
+      crc32_table[1][s[6]] ^ crc32_table[0][s[7]];
+  }
+  while (n-- > 0)
+    crc = crc32_table[0][(crc ^ *s++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+/* a raw crc (no inversions) followed by `n` zero bytes */
+static uint32_t crc32_zeros(uint32_t crc, long n)
+{
+  uint32_t p = 1u << 31; // x^0
+
+  pthread_once(&crc32_once, crc32_init);
+  for (int k = 3; n > 0; n >>= 1, k++)
+    if (n & 1) p = crc32_mult(crc32_x2n[k & 31], p);
+  return crc32_mult(p, crc);
+}
+
+/* what changing byte `old` to `new`, `after` bytes from the end of the
+   data, does to its crc: xor it in */
+static uint32_t crc32_delta(unsigned char old, unsigned char new, long after)
+{
+  pthread_once(&crc32_once, crc32_init);
+  return crc32_zeros(crc32_table[0][old ^ new], after);
+}
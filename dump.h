@@ -0,0 +1,294 @@
+// headless dump of the view layout (offset, grouped hex, ascii) to a fd.
+#include <errno.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define DUMP_BUFS    4
+#define DUMP_BUFSIZE (1 << 20)
+
+struct dumpout {
+  int fd;
+  struct iovec iov[DUMP_BUFS];
+  int cur;
+};
+
+static int dump_flush(struct dumpout *o)
+{
+  struct iovec *iov = o->iov;
+  int cnt = o->cur + 1;
+
+  while (cnt > 0) {
+    ssize_t w = writev(o->fd, iov, cnt);
+    if (w == -1) return -1;
+    while (cnt > 0 && (size_t)w >= iov->iov_len) {
+      w -= iov->iov_len; iov->iov_len = 0; iov++; cnt--;
+    }
+    if (cnt > 0) { // partial write
+      iov->iov_base = (char *)iov->iov_base + w;
+      iov->iov_len -= w;
+    }
+  }
+  for (int i = 0; i < DUMP_BUFS; i++) {
+    o->iov[i].iov_base = (char *)o->iov[0].iov_base + (long)i*DUMP_BUFSIZE;
+    o->iov[i].iov_len  = 0;
+  }
+  o->cur = 0;
+  return 0;
+}
+
+/* where the next `len` bytes of output go, flushing when all buffers fill */
+static char *dump_reserve(struct dumpout *o, int len)
+{
+  if (o->iov[o->cur].iov_len + len > DUMP_BUFSIZE) {
+    if (o->cur + 1 == DUMP_BUFS) {
+      if (dump_flush(o) == -1) return NULL;
+    } else {
+      o->cur++;
+    }
+  }
+  char *p = (char *)o->iov[o->cur].iov_base + o->iov[o->cur].iov_len;
+  o->iov[o->cur].iov_len += len;
+  return p;
+}
+
+/* one row: `n` (<= colsize) bytes of `s` living at file offset `off`,
+   returns the amount of characters written */
+static int dump_row(char *d, const unsigned char *s, int n, long off,
+  int colsize, int offdigits)
+{
+  char hex[colsize*2], *start = d;
+  int i;
+
+  fmt_offset(off, d, offdigits);
+  d += offdigits;
+  *d++ = ' '; *d++ = ' ';
+  fmt_hex(s, hex, n);
+  if (n == colsize) { // fast path, whole groups
+    for (i = 0; i < n*2; i += 8, d += 9) {
+      memcpy(d, hex + i, 8);
+      d[8] = ' ';
+    }
+  }
+  for (i = (n == colsize ? n*2 : 0); i < n*2; i += 8, d += 9) {
+    int w = (n*2 - i < 8) ? n*2 - i : 8;
+    memcpy(d, hex + i, w);
+    memset(d + w, ' ', 9 - w);
+  }
+  for (; i < colsize*2; i += 8, d += 9) // last row, pad missing groups
+    memset(d, ' ', 9);
+  *d++ = ' ';
+  fmt_printable(s, d, n);
+  d[n] = '\n';
+  return d + n + 1 - start;
+}
+
+/* returns 0 on success, -1 with errno set on write failure */
+static int dump(int fd, const unsigned char *mem, long size, long start,
+  long len, int colsize)
+{
+  struct dumpout o = { .fd = fd };
+  int offdigits = (size > 0xffffffffL ? 16 : 8);
+  int rowlen = offdigits + 2 + colsize*2 + colsize/4 + 1 + colsize + 1;
+  long end;
+
+  if (start < 0 || start > size) start = size;
+  end = (len < 0 || len > size - start) ? size : start + len;
+
+  if ((o.iov[0].iov_base = malloc((long)DUMP_BUFS*DUMP_BUFSIZE)) == NULL)
+    return -1;
+  for (int i = 0; i < DUMP_BUFS; i++)
+    o.iov[i].iov_base = (char *)o.iov[0].iov_base + (long)i*DUMP_BUFSIZE;
+
+  for (long off = start; off < end; off += colsize) {
+    int n = (end - off < colsize) ? end - off : colsize;
+    char *d = dump_reserve(&o, rowlen);
+    if (d == NULL) {
+      free(o.iov[0].iov_base);
+      return -1;
+    }
+    o.iov[o.cur].iov_len -= rowlen -
+      dump_row(d, mem + off, n, off, colsize, offdigits);
+  }
+
+  int r = dump_flush(&o);
+  free(o.iov[0].iov_base);
+  return r;
+}
+
+// undump: the dump layout (or a plain hex stream) back to bytes
+#define UNDUMP_BUFSIZE (1 << 20)
+
+struct undumpout {
+  int fd, patch;
+  long off, len;  // pending run, written on flush
+  long next;      // where a plain hex line continues
+  long written;
+  unsigned char *buf, *old;
+  char *hex;      // digits of the current line
+  long hexcap;
+};
+
+static int undump_write(int fd, const unsigned char *s, long n, long off)
+{
+  while (n > 0) {
+    ssize_t w = pwrite(fd, s, n, off);
+    if (w == -1) return -1;
+    s += w; n -= w; off += w;
+  }
+  return 0;
+}
+
+/* in patch mode only the bytes that differ from the target get written */
+static int undump_flush(struct undumpout *o)
+{
+  ssize_t r = 0;
+  long i = 0;
+
+  if (o->len == 0) return 0;
+  if (o->patch) {
+    if ((r = pread(o->fd, o->old, o->len, o->off)) == -1) return -1;
+    if (r == o->len && memcmp(o->buf, o->old, o->len) == 0)
+      i = o->len;
+  }
+  while (i < o->len) {
+    long j;
+    while (i < r && o->buf[i] == o->old[i]) i++;
+    if (i == o->len) break;
+    for (j = i; j < o->len && (j >= r || o->buf[j] != o->old[j]); j++)
+      ;
+    if (undump_write(o->fd, o->buf + i, j - i, o->off + i) == -1) return -1;
+    o->written += j - i;
+    i = j;
+  }
+  o->len = 0;
+  return 0;
+}
+
+/* room for `n` decoded bytes at file offset `off` */
+static unsigned char *undump_reserve(struct undumpout *o, long off, long n)
+{
+  if (off != o->off + o->len || o->len + n > UNDUMP_BUFSIZE) {
+    if (undump_flush(o) == -1) return NULL;
+    o->off = off;
+  }
+  o->len += n;
+  o->next = off + n;
+  return o->buf + o->len - n;
+}
+
+/* a dump row is an offset of 8 or 16 digits followed by ':' or two spaces */
+static int undump_isrow(const char *p, const char *e, long *off)
+{
+  const char *s = p;
+  unsigned long v = 0;
+  int d;
+
+  for (; s < e && (d = unhex_nibble(*s)) != -1; s++)
+    v = (v << 4) | d;
+  if ((s - p != 8 && s - p != 16) || s == e) return 0;
+  if (!(*s == ':' || (e - s > 1 && s[0] == ' ' && s[1] == ' '))) return 0;
+  *off = v;
+  return 1;
+}
+
+/* returns -1 with errno set, EINVAL on malformed lines */
+static int undump_line(struct undumpout *o, const char *p, const char *e)
+{
+  long n = 0, off;
+  char *hex;
+
+  if (e - p > o->hexcap) {
+    if ((hex = realloc(o->hex, e - p)) == NULL) return -1;
+    o->hex = hex; o->hexcap = e - p;
+  }
+  hex = o->hex;
+  while (e > p && (e[-1] == '\r' || e[-1] == ' ')) e--;
+  if (undump_isrow(p, e, &off)) {
+    while (*p != ':' && *p != ' ') p++;
+    p++;
+    while (p < e && *p == ' ') p++;
+    // groups separated by one space, two spaces start the ascii column
+    while (p < e) {
+      uint64_t g;
+      if (e - p > 8 && p[8] == ' ') { // whole 8 digit group
+        memcpy(&g, p, 8);
+        g ^= 0x2020202020202020ULL;
+        if (((g - 0x0101010101010101ULL) & ~g & 0x8080808080808080ULL) == 0) {
+          memcpy(hex + n, p, 8);
+          n += 8; p += 8;
+          continue;
+        }
+      }
+      if (*p == ' ') {
+        if (p + 1 == e || p[1] == ' ') break;
+        p++;
+        continue;
+      }
+      hex[n++] = *p++;
+    }
+  } else {
+    off = o->next;
+    for (; p < e; p++)
+      if (*p != ' ' && *p != '\t') hex[n++] = *p;
+  }
+  if (n == 0) return 0;
+  if (n % 2 != 0) { errno = EINVAL; return -1; }
+
+  for (long i = 0; i < n/2; ) {
+    long k = (n/2 - i < UNDUMP_BUFSIZE) ? n/2 - i : UNDUMP_BUFSIZE;
+    unsigned char *d = undump_reserve(o, off + i, k);
+    if (d == NULL) return -1;
+    if (fmt_unhex(hex + i*2, d, k) == -1) { errno = EINVAL; return -1; }
+    i += k;
+  }
+  return 0;
+}
+
+/* reads lines from `in` into the file at `fd`. With `patch` only ranges
+   that differ get written. Returns the amount of bytes written or -1 with
+   errno set and `*line` at the failing line */
+static long undump(int in, int fd, int patch, long *line)
+{
+  struct undumpout o = { .fd = fd, .patch = patch };
+  long cap = UNDUMP_BUFSIZE, have = 0, total = 0;
+  char *ibuf = malloc(cap);
+  int eof = 0, r = 0;
+
+  *line = 0;
+  o.buf = malloc(UNDUMP_BUFSIZE);
+  o.old = malloc(UNDUMP_BUFSIZE);
+  if (ibuf == NULL || o.buf == NULL || o.old == NULL) r = -1;
+
+  while (r == 0 && !eof) {
+    if (have == cap) { // a line longer than the buffer
+      char *n = realloc(ibuf, cap *= 2);
+      if (n == NULL) { r = -1; break; }
+      ibuf = n;
+    }
+    ssize_t rd = read(in, ibuf + have, cap - have);
+    if (rd == -1) { r = -1; break; }
+    eof  = (rd == 0);
+    have += rd;
+
+    char *p = ibuf, *end = ibuf + have, *nl;
+    while (r == 0 && (nl = memchr(p, '\n', end - p)) != NULL) {
+      ++*line;
+      r = undump_line(&o, p, nl);
+      p = nl + 1;
+    }
+    if (r == 0 && eof && p < end) { // last line without newline
+      ++*line;
+      r = undump_line(&o, p, end);
+      p = end;
+    }
+    have = end - p;
+    memmove(ibuf, p, have);
+  }
+  if (r == 0) {
+    r = undump_flush(&o);
+    total = o.written;
+  }
+
+  free(ibuf); free(o.buf); free(o.old); free(o.hex);
+  return r == -1 ? -1 : total;
+}
@@ -0,0 +1,121 @@
+// the edit engine: every byte change, from the window or from scripts,
+// goes through here.
+typedef struct editlog {
+  long off;
+  unsigned char old;
+} editlog;
+
+typedef struct edit {
+  int   fd;
+  char *mem;   // mapping of the file, NULL to go through pread/pwrite
+  long  size;
+  // journal of overwritten bytes, only kept when `logging`
+  int      logging;
+  editlog *log;
+  long     nlog, caplog;
+} edit;
+
+static int edit_read(edit *e, long off, unsigned char *d, long n)
+{
+  if (off < 0 || n < 0 || off + n > e->size) return -1;
+  if (e->mem != NULL) {
+    memcpy(d, e->mem + off, n);
+    return 0;
+  }
+  while (n > 0) {
+    ssize_t r = pread(e->fd, d, n, off);
+    if (r <= 0) return -1;
+    d += r; n -= r; off += r;
+  }
+  return 0;
+}
+
+static int edit_journal(edit *e, long off, long n)
+{
+  unsigned char old[256];
+
+  if (e->nlog + n > e->caplog) {
+    long cap = (e->caplog*2 > e->nlog + n ? e->caplog*2 : e->nlog + n + 64);
+    editlog *l = realloc(e->log, sizeof(editlog) * cap);
+    if (l == NULL) return -1;
+    e->log = l; e->caplog = cap;
+  }
+  for (long i = 0; i < n; i += sizeof(old)) {
+    long k = (n - i < sizeof(old) ? n - i : sizeof(old));
+    if (edit_read(e, off + i, old, k) == -1) return -1;
+    for (long j = 0; j < k; j++)
+      e->log[e->nlog++] = (editlog){ off + i + j, old[j] };
+  }
+  return 0;
+}
+
+/* overwrites only, the size of the file never changes */
+static int edit_write(edit *e, long off, const unsigned char *s, long n)
+{
+  if (off < 0 || n < 0 || off + n > e->size) return -1;
+  if (e->logging && edit_journal(e, off, n) == -1) return -1;
+  if (e->mem != NULL) {
+    memcpy(e->mem + off, s, n);
+    return 0;
+  }
+  while (n > 0) {
+    ssize_t w = pwrite(e->fd, s, n, off);
+    if (w == -1) return -1;
+    s += w; n -= w; off += w;
+  }
+  return 0;
+}
+
+static int edit_byte(edit *e, long off, unsigned char v)
+{
+  return edit_write(e, off, &v, 1);
+}
+
+static int edit_add(edit *e, long off, int delta)
+{
+  unsigned char v;
+  if (edit_read(e, off, &v, 1) == -1) return -1;
+  return edit_byte(e, off, (unsigned char)(v + delta));
+}
+
+static int edit_nop(edit *e, long off)
+{
+  unsigned char v;
+  if (edit_read(e, off, &v, 1) == -1) return -1;
+  return (v != 0x90 ? edit_byte(e, off, 0x90) : 0);
+}
+
+typedef struct editseq {
+  editlog l;
+  long    seq;
+} editseq;
+
+static int editseq_cmp(const void *a, const void *b)
+{
+  const editseq *x = a, *y = b;
+  if (x->l.off != y->l.off) return (x->l.off < y->l.off ? -1 : 1);
+  return (x->seq < y->seq ? -1 : (x->seq > y->seq));
+}
+
+/* the journal reduced to one entry per offset holding the byte the file
+   had before the session, sorted by offset. Caller frees */
+static editlog *edit_originals(edit *e, long *n)
+{
+  editseq *t = malloc(sizeof(editseq) * (e->nlog + 1));
+  editlog *l = malloc(sizeof(editlog) * (e->nlog + 1));
+  long k = 0;
+
+  if (t == NULL || l == NULL) {
+    free(t); free(l);
+    return NULL;
+  }
+  for (long i = 0; i < e->nlog; i++)
+    t[i] = (editseq){ e->log[i], i };
+  qsort(t, e->nlog, sizeof(editseq), editseq_cmp);
+  for (long i = 0; i < e->nlog; i++)
+    if (k == 0 || l[k-1].off != t[i].l.off)
+      l[k++] = t[i].l;
+  free(t);
+  *n = k;
+  return l;
+}
@@ -0,0 +1,148 @@
+// data extents of sparse files, from SEEK_DATA/SEEK_HOLE. Holes read as
+// zeros without the disk being touched but the mapping still faults a page
+// in for each, so paging and scans go around them instead.
+typedef struct extent {
+  long off, end;  // [off, end) has data
+} extent;
+
+// a table is never changed once published: re-reading the extents builds
+// a new one and the workers still reading the old one finish with it
+typedef struct exttab exttab;
+struct exttab {
+  long    n, size;
+  int     sparse;  // 0 when there are no holes (or no way to tell)
+  exttab *old;     // replaced before this one
+  extent  e[];
+};
+
+static exttab ext_none;
+
+static struct {
+  exttab *t;    // the current table
+  exttab *old;  // replaced ones, freed once no job runs
+} ext = { &ext_none };
+
+static exttab *ext_tab(void)
+{
+  return __atomic_load_n(&ext.t, __ATOMIC_ACQUIRE);
+}
+
+/* replaces the table, returns the amount of bytes in holes */
+static long ext_open(int fd, long size)
+{
+  long off = 0, holes = 0, n = 0;
+  exttab *t = NULL, *prev = ext.t;
+
+  while (off < size) {
+    long data = lseek(fd, off, SEEK_DATA), hole;
+    if (data == -1) {
+      if (errno != ENXIO) n = -1; // not supported, all data then
+      break; // or a hole up to the end
+    }
+    if ((hole = lseek(fd, data, SEEK_HOLE)) == -1 || hole > size) hole = size;
+    if (n % 64 == 0) {
+      exttab *g = realloc(t, sizeof(exttab) + sizeof(extent) * (n + 64));
+      if (g == NULL) { n = -1; break; }
+      t = g;
+    }
+    t->e[n++] = (extent){ data, hole };
+    holes += data - off;
+    off = hole;
+  }
+  holes += size - off;
+  if (n == -1 || holes == 0 ||
+      (t == NULL && (t = malloc(sizeof(exttab))) == NULL)) {
+    free(t);
+    t = &ext_none;
+    n = holes = 0;
+  } else {
+    t->n = n;
+    t->size = size;
+    t->sparse = 1;
+  }
+  if (prev != &ext_none) {
+    prev->old = ext.old;
+    ext.old = prev;
+  }
+  __atomic_store_n(&ext.t, t, __ATOMIC_RELEASE);
+  return holes;
+}
+
+/* frees the replaced tables, only when no worker can be reading them */
+static void ext_reclaim(void)
+{
+  while (ext.old != NULL) {
+    exttab *t = ext.old;
+    ext.old = t->old;
+    free(t);
+  }
+}
+
+/* index of the last extent starting at or before `off`, -1 if none */
+static long ext_last(const exttab *t, long off)
+{
+  long lo = 0, hi = t->n;
+
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    if (t->e[mid].off <= off) lo = mid + 1; else hi = mid;
+  }
+  return lo - 1;
+}
+
+/* 1 when `off` is in a hole, which goes on up to *end */
+static int ext_hole(long off, long *end)
+{
+  const exttab *t = ext_tab();
+  long i;
+
+  if (!t->sparse) return 0;
+  i = ext_last(t, off);
+  if (i != -1 && off < t->e[i].end) return 0;
+  *end = (i + 1 < t->n ? t->e[i + 1].off : t->size);
+  return 1;
+}
+
+/* the first data in [off, end), up to *dend; -1 if it's all a hole */
+static long ext_data(long off, long end, long *dend)
+{
+  const exttab *t = ext_tab();
+  long i;
+
+  if (off >= end) return -1;
+  if (!t->sparse) {
+    *dend = end;
+    return off;
+  }
+  if ((i = ext_last(t, off)) == -1 || off >= t->e[i].end) {
+    if (++i == t->n || t->e[i].off >= end) return -1;
+    off = t->e[i].off;
+  }
+  *dend = (t->e[i].end < end ? t->e[i].end : end);
+  return off;
+}
+
+/* start of the next data extent after `off`, or of the one before it; -1
+   when there's none */
+static long ext_next(long off, int dir)
+{
+  const exttab *t = ext_tab();
+  long i = ext_last(t, off);
+
+  if (dir > 0)
+    return (i + 1 < t->n ? t->e[i + 1].off : -1);
+  if (i != -1 && off < t->e[i].end) i--; // the start of the one we're in
+  return (i >= 0 ? t->e[i].off : -1);
+}
+
+/* the data around the hole at `off`: the first byte after it, or the last
+   one before it; -1 when there's none */
+static long ext_skip(long off, int dir)
+{
+  const exttab *t = ext_tab();
+  long i = ext_last(t, off);
+
+  if (dir > 0)
+    return (i + 1 < t->n ? t->e[i + 1].off : -1);
+  return (i >= 0 ? t->e[i].end - 1 : -1);
+}
@@ -0,0 +1,225 @@
+// a range of the file into a new one without the bytes passing through
+// here: the blocks are shared where the filesystem can (FICLONERANGE, for
+// a range that starts on a block), then copy_file_range lets the kernel
+// (or the server of a network filesystem) copy the rest, and sendfile is
+// the fallback where that isn't supported. The mapping isn't touched.
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+enum {
+  EXTRACT_COPY = 0,
+  EXTRACT_REFLINK   // the blocks are shared, at least some of them
+};
+
+static long extract_copy(int in, long off, int out, long at, long len)
+{
+  long done = 0;
+  ssize_t n = -1;
+
+  while (done < len) {
+    loff_t src = off + done, dst = at + done;
+    if ((n = copy_file_range(in, &src, out, &dst, len - done, 0)) <= 0) break;
+    done += n;
+  }
+  if (done < len) {
+    if (lseek(out, at + done, SEEK_SET) == -1) return -1;
+    while (done < len) { // ENOSYS, EXDEV, EINVAL: not between these two
+      off_t src = off + done;
+      if ((n = sendfile(out, in, &src, len - done)) <= 0) break;
+      done += n;
+    }
+  }
+  if (done == len) return 0;
+  if (n == 0) errno = EIO; // `in` ended early, truncated meanwhile
+  return -1;
+}
+
+/* a new file at `path` for [off, off+len) of `in`, with the blocks that
+   can be shared already shared (*shared of them); -1 with errno set */
+static int extract_open(int in, long off, long len, const char *path,
+  long *shared, int *r)
+{
+  struct stat st;
+  int out;
+
+  *shared = 0;
+  *r = EXTRACT_COPY;
+  if (fstat(in, &st) == -1) return -1;
+  if (off < 0 || len <= 0 || off + len > st.st_size) {
+    errno = EINVAL;
+    return -1;
+  }
+  if ((out = open(path, O_WRONLY|O_CREAT|O_EXCL, 0644)) == -1) return -1;
+  if (off % st.st_blksize == 0) {
+    // whole blocks, or up to the end of the file
+    struct file_clone_range c = { in, off,
+      (off + len == st.st_size ? len : len / st.st_blksize * st.st_blksize),
+      0 };
+    if (c.src_length > 0 && ioctl(out, FICLONERANGE, &c) == 0) {
+      *shared = c.src_length;
+      *r = EXTRACT_REFLINK;
+    }
+  }
+  return out;
+}
+
+/* closes what extract_open() opened, removed unless it's `ok` */
+static int extract_close(int out, const char *path, int ok)
+{
+  int e = errno;
+
+  if (close(out) == -1 && ok) {
+    e = errno;
+    ok = 0;
+  }
+  if (ok) return 0;
+  unlink(path);
+  errno = e;
+  return -1;
+}
+
+/* [off, off+len) of `in` to a new file at `path`, -1 with errno set */
+static int extract(int in, long off, long len, const char *path)
+{
+  long shared;
+  int out, r, ok;
+
+  if ((out = extract_open(in, off, len, path, &shared, &r)) == -1)
+    return -1;
+  ok = (extract_copy(in, off + shared, out, shared, len - shared) == 0);
+  return (extract_close(out, path, ok) == -1 ? -1 : r);
+}
+
+/* n bytes at `off` into buf, fewer at the end of the file, -1 on errors */
+static long extract_read(int fd, char *buf, long n, long off)
+{
+  long got = 0;
+
+  while (got < n) {
+    ssize_t r = pread(fd, buf + got, n - got, off + got);
+    if (r == -1 && errno == EINTR) continue;
+    if (r == -1) return -1;
+    if (r == 0) break;
+    got += r;
+  }
+  return got;
+}
+
+// extracting from the view is a job: the footer of an embedded file may be
+// anywhere up to the end and a copy the kernel can't share takes as long
+// as the bytes are many. The footer is read with pread, the mapping is for
+// what's on screen.
+#define EXTRACT_PIECE (16L << 20) // copied between looks at the cancel
+#define CARVE_BLOCK   (1L << 20)  // read at a time looking for a footer
+#define CARVE_HEAD    16          // the longest header
+
+typedef struct xjob {
+  job   j;
+  int   in;
+  long  off, len, size;  // len is 0 until a footer is found when carving
+  int   m;               // the first magic to try carving by, -1 if not
+  char  path[PATH_MAX];  // the suffix is appended to it when carving
+  int   pct;             // of the search, then of the copy
+  int   r, err;          // what extract() would return, and errno
+} xjob;
+
+/* where the first footer of `m` after the header ends, -1 if there's none
+   (or it's cancelled, or a read failed: err is set then) */
+static long carve_footer(xjob *x, const magic *m, char *buf)
+{
+  long want = CARVE_BLOCK + m->ftr_len - 1, span = x->size - x->off;
+
+  for (long at = x->off + m->hdr_len; at < x->size; at += CARVE_BLOCK) {
+    long n = extract_read(x->in, buf, want, at);
+    const char *f;
+    if (n == -1) x->err = errno;
+    if (n == -1 || job_cancelled(&x->j)) return -1;
+    if ((f = memmem(buf, n, m->footer, m->ftr_len)) != NULL)
+      return at + (f - buf) + m->ftr_len;
+    if (n < want) break;
+    __atomic_store_n(&x->pct, (int)((at - x->off) * 100 / span),
+      __ATOMIC_RELAXED);
+  }
+  return -1;
+}
+
+/* the length of the embedded file at x->off, 0 if no footer is found */
+static long carve_len(xjob *x)
+{
+  char head[CARVE_HEAD], *buf;
+  unsigned char after[18];
+  long end = -1, n;
+  int i = x->m;
+
+  if ((n = extract_read(x->in, head, sizeof(head), x->off)) == -1 ||
+      (buf = malloc(CARVE_BLOCK + CARVE_HEAD)) == NULL) {
+    x->err = errno;
+    return 0;
+  }
+  for (; i != -1 && end == -1 && x->err == 0 && !job_cancelled(&x->j);
+      i = carve_magic(head, n, 0, i + 1))
+    if ((end = carve_footer(x, &magics[i], buf)) != -1)
+      break;
+  free(buf);
+  if (end == -1) return 0;
+  n = extract_read(x->in, (char *)after, sizeof(after), end);
+  end = carve_end(&magics[i], end, after, (n == -1 ? 0 : n), x->size);
+  strncat(x->path, magics[i].suffix, sizeof(x->path) - strlen(x->path) - 1);
+  return end - x->off;
+}
+
+static void extract_run(job *j, long chunk)
+{
+  xjob *x = (xjob *)j;
+  long shared, done;
+  int out, ok = 1;
+
+  (void)chunk;
+  if (x->m != -1 && (x->len = carve_len(x)) == 0) return;
+  __atomic_store_n(&x->pct, 0, __ATOMIC_RELAXED);
+  if ((out = extract_open(x->in, x->off, x->len, x->path, &shared,
+      &x->r)) == -1) {
+    x->err = errno;
+    return;
+  }
+  for (done = shared; done < x->len && ok; done += EXTRACT_PIECE) {
+    long n = (x->len - done < EXTRACT_PIECE ? x->len - done : EXTRACT_PIECE);
+    if (job_cancelled(j)) break;
+    ok = (extract_copy(x->in, x->off + done, out, done, n) == 0);
+    __atomic_store_n(&x->pct, (int)((done + n) * 100 / x->len),
+      __ATOMIC_RELAXED);
+  }
+  ok = (ok && done >= x->len && !job_cancelled(j)); // else it's removed
+  if (extract_close(out, x->path, ok) == -1 && !job_cancelled(j))
+    x->err = errno;
+}
+
+static int extract_progress(job *j)
+{
+  return __atomic_load_n(&((xjob *)j)->pct, __ATOMIC_RELAXED);
+}
+
+/* [off, off+len) of `in` to `path`, or with len 0 the embedded file whose
+   header of magic m is at `off` to `path` and its suffix */
+static xjob *extract_new(int in, long size, long off, long len, int m,
+  const char *path, void (*deliver)(job *))
+{
+  xjob *x;
+
+  if ((x = calloc(1, sizeof(xjob))) == NULL) return NULL;
+  x->j = (job){
+    .name = "extract",
+    .nchunks = 1,
+    .run = extract_run,
+    .deliver = deliver,
+    .progress = extract_progress
+  };
+  x->in   = in;
+  x->size = size;
+  x->off  = off;
+  x->len  = len;
+  x->m    = m;
+  snprintf(x->path, sizeof(x->path), "%s", path);
+  return x;
+}
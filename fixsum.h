@@ -0,0 +1,330 @@
+// checksums the edits of the session left stale: PNG chunk crcs, the crc-32
+// of ZIP entries (central directory, local header or data descriptor), the
+// trailer of gzip members and the PE checksum. Only structures with edited
+// bytes are looked at. Where the checksum is over the bytes as they are in
+// the file (PNG, stored ZIP entries, PE) it is fixed from the one before
+// the session and the changed bytes alone, otherwise (deflated data) the
+// touched entry or member is decoded again, so they're found by a job and
+// made on the ui thread after it. Fixes go through the edit engine, so
+// they're in the journal like any other edit.
+#include <zlib.h>
+
+typedef struct fixput {
+  long     off;
+  int      n, be;
+  uint32_t v;
+} fixput;
+
+typedef struct fixsum {
+  job      j;
+  edit    *e;
+  editlog *orig;   // the bytes before the session, sorted by offset
+  long     n;
+  long     nlog;   // of the journal the fixes are for
+  fixput  *put;    // what to write, see fix_apply()
+  long     nput, cap;
+  int      stale;  // checksums, one per chunk, entry or member
+  int      err;
+} fixsum;
+
+static unsigned char fix_orig(fixsum *f, long off) /* before the session */
+{
+  long lo = 0, hi = f->n;
+
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    if (f->orig[mid].off < off) lo = mid + 1; else hi = mid;
+  }
+  if (lo < f->n && f->orig[lo].off == off) return f->orig[lo].old;
+  return (unsigned char)f->e->mem[off];
+}
+
+static long fix_first(fixsum *f, long off) /* first edit at or after off */
+{
+  long lo = 0, hi = f->n;
+
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    if (f->orig[mid].off < off) lo = mid + 1; else hi = mid;
+  }
+  return lo;
+}
+
+static int fix_touched(fixsum *f, long a, long b)
+{
+  long i = fix_first(f, a);
+  return (i < f->n && f->orig[i].off < b);
+}
+
+static uint32_t fix_get(fixsum *f, long off, int n, int be, int orig)
+{
+  uint32_t v = 0;
+
+  for (int i = 0; i < n; i++) {
+    unsigned char c = (orig ? fix_orig(f, off + i) :
+      (unsigned char)f->e->mem[off + i]);
+    v |= (uint32_t)c << 8*(be ? n-1-i : i);
+  }
+  return v;
+}
+
+/* 1 when the checksum at `off` isn't `v`, its fix is kept then */
+static int fix_put(fixsum *f, long off, int n, int be, uint32_t v)
+{
+  if (fix_get(f, off, n, be, 0) == v) return 0;
+  if (f->nput == f->cap) {
+    fixput *p = realloc(f->put, sizeof(fixput) * (f->cap*2 + 8));
+    if (p == NULL) {
+      f->err = errno;
+      return 1;
+    }
+    f->put = p;
+    f->cap = f->cap*2 + 8;
+  }
+  f->put[f->nput++] = (fixput){ off, n, be, v };
+  return 1;
+}
+
+/* the crc of [a, b) now, from the one it had before the session */
+static uint32_t fix_crc(fixsum *f, uint32_t before, long a, long b)
+{
+  for (long i = fix_first(f, a); i < f->n && f->orig[i].off < b; i++) {
+    long off = f->orig[i].off;
+    before ^= crc32_delta(f->orig[i].old, (unsigned char)f->e->mem[off],
+      b - off - 1);
+  }
+  return before;
+}
+
+/* crc-32 and length of the raw deflate data at `off`, -1 if it's broken;
+   *end is where the data stops */
+static int fix_inflate(fixsum *f, long off, uint32_t *crc, long *len,
+  long *end)
+{
+  unsigned char buf[1 << 16];
+  z_stream z;
+  int ret;
+
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, -15) != Z_OK) return -1;
+  z.next_in  = (unsigned char *)f->e->mem + off;
+  z.avail_in = 0;
+  *crc = 0;
+  *len = 0;
+  do {
+    long in = z.next_in - (unsigned char *)f->e->mem;
+    if (z.avail_in == 0)
+      z.avail_in = (f->e->size - in > (1L << 30) ? (1L << 30) :
+        f->e->size - in);
+    z.next_out  = buf;
+    z.avail_out = sizeof(buf);
+    ret = inflate(&z, Z_NO_FLUSH);
+    *crc = crc32_update(*crc, buf, sizeof(buf) - z.avail_out);
+    *len += sizeof(buf) - z.avail_out;
+  } while (ret == Z_OK);
+  *end = z.next_in - (unsigned char *)f->e->mem;
+  inflateEnd(&z);
+  return (ret == Z_STREAM_END ? 0 : -1);
+}
+
+static void fix_png(fixsum *f)
+{
+  long p = 8, size = f->e->size;
+
+  while (p + 12 <= size) {
+    long len = fix_get(f, p, 4, 1, 0);
+    if (len > size - p - 12) break;
+    if (fix_touched(f, p + 4, p + 8 + len)) // type and data
+      f->stale += fix_put(f, p + 8 + len, 4, 1,
+        fix_crc(f, fix_get(f, p + 8 + len, 4, 1, 1), p + 4, p + 8 + len));
+    if (memcmp(f->e->mem + p + 4, "IEND", 4) == 0) break;
+    p += 12 + len;
+  }
+}
+
+static void fix_zip(fixsum *f)
+{
+  const char *m = f->e->mem;
+  long size = f->e->size, eocd = -1, q, entries;
+
+  for (long p = size - 22; p >= 0 && p >= size - 22 - 0xffff; p--)
+    if (memcmp(m + p, "PK\5\6", 4) == 0) {
+      eocd = p;
+      break;
+    }
+  if (eocd == -1) return;
+  entries = fix_get(f, eocd + 10, 2, 0, 0);
+  q = fix_get(f, eocd + 16, 4, 0, 0);
+  for (long i = 0; i < entries && q + 46 <= size &&
+      memcmp(m + q, "PK\1\2", 4) == 0; i++) {
+    int  method = fix_get(f, q + 10, 2, 0, 0);
+    long csize  = fix_get(f, q + 20, 4, 0, 0),
+         lo     = fix_get(f, q + 42, 4, 0, 0), data;
+    uint32_t crc;
+    if (lo + 30 <= size && memcmp(m + lo, "PK\3\4", 4) == 0 &&
+        csize != 0xffffffff) { // not zip64
+      data = lo + 30 + fix_get(f, lo + 26, 2, 0, 0) +
+        fix_get(f, lo + 28, 2, 0, 0);
+      if (data + csize <= size && fix_touched(f, data, data + csize)) {
+        long len, end;
+        int ok = 1;
+        if (method == 0)
+          crc = fix_crc(f, fix_get(f, q + 16, 4, 0, 1), data, data + csize);
+        else
+          ok = (method == 8 && fix_inflate(f, data, &crc, &len, &end) == 0);
+        if (ok) { // both copies of the crc are the one stale checksum
+          long dd = data + csize; // a data descriptor, maybe signed
+          int  st = fix_put(f, q + 16, 4, 0, crc);
+          if (!(fix_get(f, lo + 6, 2, 0, 0) & 8))
+            st |= fix_put(f, lo + 14, 4, 0, crc);
+          else if (dd + 8 <= size)
+            st |= fix_put(f, dd + (fix_get(f, dd, 4, 0, 0) == 0x08074b50 ?
+              4 : 0), 4, 0, crc);
+          f->stale += st;
+        }
+      }
+    }
+    q += 46 + fix_get(f, q + 28, 2, 0, 0) + fix_get(f, q + 30, 2, 0, 0) +
+      fix_get(f, q + 32, 2, 0, 0);
+  }
+}
+
+static void fix_gzip(fixsum *f)
+{
+  const unsigned char *m = (const unsigned char *)f->e->mem;
+  long p = 0, size = f->e->size, last;
+
+  if (f->n == 0) return;
+  last = f->orig[f->n - 1].off;
+  // members end where their data does, which takes decoding them
+  while (p <= last && p + 18 <= size && m[p] == 0x1F && m[p+1] == 0x8B &&
+      m[p+2] == 8 && !job_cancelled(&f->j)) {
+    int flags = m[p+3];
+    long h = p + 10, len, end;
+    uint32_t crc;
+    if (flags & 4) h += 2 + (m[h] | m[h+1] << 8);  // extra
+    if (flags & 8) h += strnlen((char *)m + h, size - h) + 1; // name
+    if (flags & 16) h += strnlen((char *)m + h, size - h) + 1; // comment
+    if (flags & 2) h += 2; // header crc
+    if (h >= size || fix_inflate(f, h, &crc, &len, &end) == -1 ||
+        end + 8 > size)
+      return;
+    if (fix_touched(f, h, end))
+      f->stale += (fix_put(f, end, 4, 0, crc) |
+        fix_put(f, end + 4, 4, 0, (uint32_t)len));
+    p = end + 8;
+  }
+}
+
+static uint32_t fix_pesum(fixsum *f, long ck) /* all of it, the slow way */
+{
+  const unsigned char *m = (const unsigned char *)f->e->mem;
+  long size = f->e->size;
+  uint64_t sum = 0;
+
+  for (long i = 0; i < size; i += 2) {
+    if (i == ck || i == ck + 2) continue;
+    sum += m[i] | (i + 1 < size ? m[i+1] << 8 : 0);
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  sum = (sum & 0xffff) + (sum >> 16);
+  return (uint32_t)sum + size;
+}
+
+static void fix_pe(fixsum *f)
+{
+  long size = f->e->size, pe, ck;
+  uint32_t before, sum;
+
+  if (size < 0x40) return;
+  pe = fix_get(f, 0x3C, 4, 0, 0);
+  if (pe + 24 + 68 > size || memcmp(f->e->mem + pe, "PE\0\0", 4) != 0)
+    return;
+  ck = pe + 24 + 64;
+  if ((before = fix_get(f, ck, 4, 0, 1)) == 0) return; // not checked
+  // one's complement sum of 16 bit words: take out the old, add the new
+  sum = (before - size) & 0xffff;
+  for (long i = 0; i < f->n; i++) {
+    long w = f->orig[i].off & ~1L;
+    uint32_t old, new;
+    if ((w >= ck && w < ck + 4) || (i > 0 && (f->orig[i-1].off & ~1L) == w))
+      continue;
+    old = fix_orig(f, w) | (w + 1 < size ? fix_orig(f, w + 1) << 8 : 0);
+    new = fix_get(f, w, (w + 1 < size ? 2 : 1), 0, 0);
+    sum += (~old & 0xffff) + new;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  if (sum == 0 || sum == 0xffff) // both are zero here, not in the file
+    f->stale += fix_put(f, ck, 4, 0, fix_pesum(f, ck));
+  else
+    f->stale += fix_put(f, ck, 4, 0, sum + size);
+}
+
+/* the format of the file, 0 when it has no checksums we know */
+static int fix_kind(edit *e)
+{
+  if (e->size >= 8 && memcmp(e->mem, "\x89PNG\r\n\x1a\n", 8) == 0) return 1;
+  if (e->size >= 4 && memcmp(e->mem, "PK\3\4", 4) == 0) return 2;
+  if (e->size >= 3 && memcmp(e->mem, "\x1F\x8B\x08", 3) == 0) return 3;
+  if (e->size >= 2 && memcmp(e->mem, "MZ", 2) == 0) return 4;
+  return 0;
+}
+
+static void fix_run(job *j, long chunk)
+{
+  fixsum *f = (fixsum *)j;
+
+  switch (fix_kind(f->e)) {
+    case 1: fix_png(f); break;
+    case 2: fix_zip(f); break;
+    case 3: fix_gzip(f); break;
+    case 4: fix_pe(f); break;
+  }
+}
+
+/* a job finding the checksums the journal left stale; NULL when there's
+   nothing to look at, or on errors (with errno set) */
+static fixsum *fix_new(edit *e, void (*deliver)(job *))
+{
+  fixsum *f;
+
+  errno = 0;
+  if (e->mem == NULL || e->nlog == 0 || fix_kind(e) == 0) return NULL;
+  if ((f = calloc(1, sizeof(fixsum))) == NULL) return NULL;
+  if ((f->orig = edit_originals(e, &f->n)) == NULL) {
+    free(f);
+    return NULL;
+  }
+  f->j = (job){
+    .name = "checksums",
+    .nchunks = 1,
+    .run = fix_run,
+    .deliver = deliver
+  };
+  f->e    = e;
+  f->nlog = e->nlog;
+  return f;
+}
+
+/* writes the fixes found, on the ui thread and for the journal they were
+   found for only */
+static void fix_apply(fixsum *f)
+{
+  unsigned char b[4];
+
+  for (long i = 0; i < f->nput; i++) {
+    fixput *p = &f->put[i];
+    for (int k = 0; k < p->n; k++)
+      b[k] = p->v >> 8*(p->be ? p->n-1-k : k);
+    edit_write(f->e, p->off, b, p->n);
+  }
+}
+
+static void fix_free(fixsum *f)
+{
+  if (f == NULL) return;
+  free(f->orig);
+  free(f->put);
+  free(f);
+}
@@ -0,0 +1,151 @@
+// byte formatting kernels shared by the view and the headless modes.
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+// table versions, what the SIMD ones fall back to and get measured against
+
+static void fmt_hex_lut(const unsigned char *s, char *d, long n)
+{
+  for (long i = 0; i < n; i++) {
+    d[i*2]   = hexdigits[s[i] >> 4];
+    d[i*2+1] = hexdigits[s[i] & 0xf];
+  }
+}
+
+static void fmt_printable_lut(const unsigned char *s, char *d, long n)
+{
+  for (long i = 0; i < n; i++)
+    d[i] = (s[i] < 0x20 || s[i] > 0x7e) ? '.' : s[i];
+}
+
+static int unhex_nibble(unsigned char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+static int fmt_unhex_lut(const char *s, unsigned char *d, long n)
+{
+  for (long i = 0; i < n; i++) {
+    int hi = unhex_nibble(s[i*2]), lo = unhex_nibble(s[i*2+1]);
+    if (hi == -1 || lo == -1) return -1;
+    d[i] = (hi << 4) | lo;
+  }
+  return 0;
+}
+
+/* `n` bytes from `s` to 2*n uppercase hex digits in `d` (not terminated) */
+static void fmt_hex(const unsigned char *s, char *d, long n)
+{
+  long i = 0;
+#ifdef __SSE2__
+  const __m128i mask  = _mm_set1_epi8(0x0f),
+                nine  = _mm_set1_epi8(9),
+                zero  = _mm_set1_epi8('0'),
+                alpha = _mm_set1_epi8('A' - '0' - 10);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v  = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i lo = _mm_and_si128(v, mask);
+    hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+      _mm_and_si128(_mm_cmpgt_epi8(hi, nine), alpha));
+    lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+      _mm_and_si128(_mm_cmpgt_epi8(lo, nine), alpha));
+    _mm_storeu_si128((__m128i *)(d + i*2), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(d + i*2 + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+#endif
+  fmt_hex_lut(s + i, d + i*2, n - i);
+}
+
+/* anything outside 0x20-0x7e becomes a dot */
+static void fmt_printable(const unsigned char *s, char *d, long n)
+{
+  long i = 0;
+#ifdef __SSE2__
+  // signed compare after adding one: 0x7f and 0x80-0xff end up negative
+  const __m128i one   = _mm_set1_epi8(1),
+                lower = _mm_set1_epi8(0x20),
+                dots  = _mm_set1_epi8('.');
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i m = _mm_cmpgt_epi8(_mm_add_epi8(v, one), lower);
+    _mm_storeu_si128((__m128i *)(d + i),
+      _mm_or_si128(_mm_and_si128(m, v), _mm_andnot_si128(m, dots)));
+  }
+#endif
+  fmt_printable_lut(s + i, d + i, n - i);
+}
+
+/* `digits` uppercase hex digits of `off` to `d` (not terminated) */
+static void fmt_offset(unsigned long off, char *d, int digits)
+{
+  for (int i = digits - 1; i >= 0; i--, off >>= 4)
+    d[i] = hexdigits[off & 0xf];
+}
+
+/* 2*n hex digits (either case) from `s` to `n` bytes in `d`,
+   returns -1 if there's anything that is not a hex digit */
+static int fmt_unhex(const char *s, unsigned char *d, long n)
+{
+  long i = 0;
+#ifdef __SSE2__
+  const __m128i c0  = _mm_set1_epi8('0'), ca = _mm_set1_epi8('a'),
+                low = _mm_set1_epi8(0x20), m1 = _mm_set1_epi8(-1),
+                c10 = _mm_set1_epi8(10), c6 = _mm_set1_epi8(6),
+                lob = _mm_set1_epi16(0x00ff);
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i*2));
+    __m128i dg = _mm_sub_epi8(v, c0);
+    __m128i al = _mm_sub_epi8(_mm_or_si128(v, low), ca);
+    __m128i isdg = _mm_and_si128(_mm_cmpgt_epi8(dg, m1),
+      _mm_cmplt_epi8(dg, c10));
+    __m128i isal = _mm_and_si128(_mm_cmpgt_epi8(al, m1),
+      _mm_cmplt_epi8(al, c6));
+    if (_mm_movemask_epi8(_mm_or_si128(isdg, isal)) != 0xffff)
+      return -1;
+    __m128i val = _mm_or_si128(_mm_and_si128(isdg, dg),
+      _mm_and_si128(isal, _mm_add_epi8(al, c10)));
+    // even chars are the high nibble, odd ones the low nibble
+    __m128i w = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(val, lob), 4),
+      _mm_srli_epi16(val, 8));
+    _mm_storel_epi64((__m128i *)(d + i), _mm_packus_epi16(w, w));
+  }
+#endif
+  return fmt_unhex_lut(s + i*2, d + i, n - i);
+}
+
+/* a row of the view: hex digits and printable characters of `n` bytes in
+   one pass, both already glyph indices for the renderer */
+static void fmt_row(const unsigned char *s, int n, char *hex, char *ascii)
+{
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i mask  = _mm_set1_epi8(0x0f), nine = _mm_set1_epi8(9),
+                zero  = _mm_set1_epi8('0'),
+                alpha = _mm_set1_epi8('A' - '0' - 10),
+                one   = _mm_set1_epi8(1), lower = _mm_set1_epi8(0x20),
+                dots  = _mm_set1_epi8('.');
+  for (; i + 16 <= n; i += 16) {
+    __m128i v  = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i lo = _mm_and_si128(v, mask);
+    __m128i p  = _mm_cmpgt_epi8(_mm_add_epi8(v, one), lower);
+    hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+      _mm_and_si128(_mm_cmpgt_epi8(hi, nine), alpha));
+    lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+      _mm_and_si128(_mm_cmpgt_epi8(lo, nine), alpha));
+    _mm_storeu_si128((__m128i *)(hex + i*2), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(hex + i*2 + 16), _mm_unpackhi_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(ascii + i),
+      _mm_or_si128(_mm_and_si128(p, v), _mm_andnot_si128(p, dots)));
+  }
+#endif
+  fmt_hex_lut(s + i, hex + i*2, n - i);
+  fmt_printable_lut(s + i, ascii + i, n - i);
+}
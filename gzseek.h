@@ -0,0 +1,350 @@
+// random access into gzip files. The stream is decoded once in the
+// background and every GZ_SPAN decoded bytes, at a deflate block boundary,
+// the decoder state is kept: where it is in both streams, the bits left of
+// the last byte read and the 32 KiB window back references can reach. Any
+// offset is then decoded from the checkpoint before it; the decoded pages
+// go through pcache.h. The checkpoints are saved in a `.gzi` sidecar (see
+// sidecar.h) next to the notes, valid while the file is the same.
+//
+//   "hexgzi" <version:2>                          integers little endian
+//   <size:8> <out:8> <n:8> <dev:8> <ino:8> <sec:8> <nsec:8>
+//   n times <out:8> <in:8> <bits:4> <window:32768>
+#include <zlib.h>
+
+#define GZ_SPAN (4L << 20)
+#define GZ_WIN  32768
+#define GZI_VERSION 2  // 1 wrote the structs as they were in memory
+
+typedef struct gzpoint {
+  long out, in;  // decoded offset, compressed offset to continue from
+  int  bits;     // of the byte before `in` still to decode, -1 for a header
+  unsigned char window[GZ_WIN];
+} gzpoint;
+
+typedef struct gzhead { // of the sidecar
+  long size, out, n;
+  unsigned long dev, ino;
+  long sec, nsec;
+} gzhead;
+
+typedef struct gzjob {
+  job   j;
+  long  in;      // progress
+  gzpoint *p;
+  long  n, cap, out;
+} gzjob;
+
+static struct gzview {
+  const unsigned char *mem;
+  long  size;    // compressed
+  int   fd;
+  gzpoint *p;
+  long  n, out;  // checkpoints and decoded size, n is 0 until indexed
+  // the decoder of the view, continued when reading on from where it is
+  z_stream z;
+  int   live, raw;
+  long  at;      // decoded offset it has reached
+  char  sidecar[PATH_MAX];
+} gz;
+
+static int gz_member(long in) /* a gzip header at `in` */
+{
+  return (in + 3 <= gz.size && gz.mem[in] == 0x1F && gz.mem[in+1] == 0x8B &&
+    gz.mem[in+2] == 0x08);
+}
+
+static int gz_point(gzjob *g, long out, long in, int bits,
+  const unsigned char *win, int left)
+{
+  gzpoint *p;
+
+  if (g->n == g->cap) {
+    p = realloc(g->p, sizeof(gzpoint) * (g->cap = g->cap*2 + 16));
+    if (p == NULL) return -1;
+    g->p = p;
+  }
+  p = &g->p[g->n++];
+  *p = (gzpoint){ .out = out, .in = in, .bits = bits };
+  if (win != NULL) { // the oldest bytes of the circular window come first
+    memcpy(p->window, win + GZ_WIN - left, left);
+    memcpy(p->window + left, win, GZ_WIN - left);
+  }
+  return 0;
+}
+
+static void gz_put(FILE *f, uint64_t v, int n) /* little endian */
+{
+  for (int i = 0; i < n; i++)
+    putc(v >> 8*i & 0xff, f);
+}
+
+/* the checkpoints of a job to the sidecar, before they're handed over */
+static int gz_save(gzjob *g)
+{
+  char tmp[PATH_MAX + 4];
+  struct stat st;
+  FILE *f;
+
+  if (*gz.sidecar == '\0' || fstat(gz.fd, &st) == -1) return -1;
+  snprintf(tmp, sizeof(tmp), "%s.tmp", gz.sidecar);
+  if ((f = fopen(tmp, "w")) == NULL) return -1;
+  fwrite("hexgzi", 1, 6, f);
+  gz_put(f, GZI_VERSION, 2);
+  gz_put(f, gz.size, 8);
+  gz_put(f, g->out, 8);
+  gz_put(f, g->n, 8);
+  gz_put(f, st.st_dev, 8);
+  gz_put(f, st.st_ino, 8);
+  gz_put(f, st.st_mtim.tv_sec, 8);
+  gz_put(f, st.st_mtim.tv_nsec, 8);
+  for (long i = 0; i < g->n; i++) {
+    gz_put(f, g->p[i].out, 8);
+    gz_put(f, g->p[i].in, 8);
+    gz_put(f, (uint32_t)g->p[i].bits, 4);
+    fwrite(g->p[i].window, 1, GZ_WIN, f);
+  }
+  if (ferror(f) | (fclose(f) == EOF) || rename(tmp, gz.sidecar) == -1) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/* decodes everything once, a damaged or cut stream is indexed up to there */
+static void gz_build(job *j, long chunk)
+{
+  gzjob *g = (gzjob *)j;
+  unsigned char win[GZ_WIN];
+  z_stream z;
+  long out = 0, last = 0;
+
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, 47) != Z_OK || gz_point(g, 0, 0, -1, NULL, 0) == -1)
+    return;
+  z.next_in = (unsigned char *)gz.mem;
+  while (!job_cancelled(j)) {
+    long in = z.next_in - gz.mem;
+    int before, ret;
+    if (z.avail_in == 0) {
+      if (in == gz.size) break;
+      z.avail_in = (gz.size - in > (1L << 20) ? (1L << 20) : gz.size - in);
+      __atomic_store_n(&g->in, in, __ATOMIC_RELAXED);
+    }
+    if (z.avail_out == 0) {
+      z.next_out  = win;
+      z.avail_out = GZ_WIN;
+    }
+    before = z.avail_out;
+    ret = inflate(&z, Z_BLOCK);
+    out += before - z.avail_out;
+    in   = z.next_in - gz.mem;
+    if (ret == Z_STREAM_END) {
+      if (!gz_member(in)) break; // trailing garbage isn't shown
+      inflateReset2(&z, 47);
+      if (out - last > GZ_SPAN && gz_point(g, out, in, -1, NULL, 0) == 0)
+        last = out;
+      continue;
+    }
+    if (ret != Z_OK) break;
+    if ((z.data_type & 128) && !(z.data_type & 64) && out - last > GZ_SPAN &&
+        gz_point(g, out, in, z.data_type & 7, win, z.avail_out) == 0)
+      last = out;
+  }
+  g->out = out;
+  inflateEnd(&z);
+  if (!job_cancelled(j)) gz_save(g);
+}
+
+static int gz_progress(job *j)
+{
+  gzjob *g = (gzjob *)j;
+  return __atomic_load_n(&g->in, __ATOMIC_RELAXED) * 100 / gz.size;
+}
+
+static gzjob *gz_new(void (*deliver)(job *))
+{
+  gzjob *g;
+
+  if ((g = calloc(1, sizeof(gzjob))) == NULL) return NULL;
+  g->j = (job){
+    .name = "gunzip",
+    .nchunks = 1,
+    .run = gz_build,
+    .deliver = deliver,
+    .progress = gz_progress
+  };
+  return g;
+}
+
+/* the checkpoints of a finished job become the index */
+static void gz_take(gzjob *g)
+{
+  free(gz.p);
+  gz.p   = g->p;
+  gz.n   = g->n;
+  gz.out = g->out;
+  g->p   = NULL;
+  gz.live = 0;
+}
+
+static int gz_same(gzhead *h) /* the sidecar is about this very file */
+{
+  struct stat st;
+
+  return (fstat(gz.fd, &st) == 0 && h->size == gz.size &&
+    h->dev == st.st_dev && h->ino == st.st_ino &&
+    h->sec == st.st_mtim.tv_sec && h->nsec == st.st_mtim.tv_nsec);
+}
+
+
+static uint64_t gz_get(FILE *f, int n) /* check feof() after */
+{
+  uint64_t v = 0;
+
+  for (int i = 0; i < n; i++)
+    v |= (uint64_t)(getc(f) & 0xff) << 8*i;
+  return v;
+}
+
+static int gz_load(void) /* the index from the sidecar, -1 if there's none */
+{
+  char magic[6];
+  gzhead h;
+  gzpoint *p;
+  FILE *f;
+
+  if (*gz.sidecar == '\0' || (f = fopen(gz.sidecar, "r")) == NULL) return -1;
+  if (fread(magic, 1, 6, f) != 6 || memcmp(magic, "hexgzi", 6) != 0 ||
+      gz_get(f, 2) != GZI_VERSION) { // another format
+    fclose(f);
+    return -1;
+  }
+  h.size = gz_get(f, 8);
+  h.out  = gz_get(f, 8);
+  h.n    = gz_get(f, 8);
+  h.dev  = gz_get(f, 8);
+  h.ino  = gz_get(f, 8);
+  h.sec  = gz_get(f, 8);
+  h.nsec = gz_get(f, 8);
+  if (feof(f) || !gz_same(&h) || h.n < 1 ||
+      h.n > LONG_MAX / (long)sizeof(gzpoint) ||
+      (p = malloc(sizeof(gzpoint) * h.n)) == NULL) {
+    fclose(f);
+    return -1;
+  }
+  for (long i = 0; i < h.n; i++) {
+    p[i].out  = gz_get(f, 8);
+    p[i].in   = gz_get(f, 8);
+    p[i].bits = (int32_t)gz_get(f, 4);
+    if (fread(p[i].window, 1, GZ_WIN, f) != GZ_WIN) break;
+    // read as they are, so a checkpoint in the file or decoded size
+    if (p[i].in < (p[i].bits > 0) || p[i].in > h.size ||
+        p[i].bits < -1 || p[i].bits > 7 || p[i].out > h.out ||
+        p[i].out < (i == 0 ? 0 : p[i-1].out + 1)) {
+      h.n = -1;
+      break;
+    }
+  }
+  if (h.n == -1 || feof(f) || ferror(f)) {
+    free(p);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  free(gz.p);
+  gz.p   = p;
+  gz.n   = h.n;
+  gz.out = h.out;
+  gz.live = 0;
+  return 0;
+}
+
+/* 1 for a gzip file, its sidecar is looked for then */
+static int gz_open(const char *file, int fd, const char *mem, long size)
+{
+  char real[PATH_MAX];
+
+  gz = (struct gzview){ .mem = (const unsigned char *)mem, .size = size,
+    .fd = fd };
+  if (!gz_member(0)) return 0;
+  if (realpath(file, real) != NULL)
+    sidecar_path(real, "gzi", gz.sidecar, sizeof(gz.sidecar));
+  return 1;
+}
+
+static void gz_seek(long i) /* the decoder of the view at checkpoint i */
+{
+  gzpoint *p = &gz.p[i];
+
+  if (gz.z.state == NULL && inflateInit2(&gz.z, 47) != Z_OK) return;
+  gz.raw = (p->bits != -1);
+  inflateReset2(&gz.z, gz.raw ? -15 : 47);
+  gz.z.next_in  = (unsigned char *)gz.mem + p->in - (p->bits > 0);
+  gz.z.avail_in = 0;
+  if (p->bits > 0) {
+    inflatePrime(&gz.z, p->bits, gz.mem[p->in - 1] >> (8 - p->bits));
+    gz.z.next_in++;
+  }
+  if (gz.raw) inflateSetDictionary(&gz.z, p->window, GZ_WIN);
+  gz.at   = p->out;
+  gz.live = 1;
+}
+
+/* up to `len` decoded bytes into `buf` from where the decoder is */
+static long gz_read(unsigned char *buf, long len)
+{
+  z_stream *z = &gz.z;
+  long got = 0;
+
+  while (got < len && gz.live) {
+    long in = z->next_in - gz.mem;
+    int before, ret;
+    if (z->avail_in == 0) {
+      if (in >= gz.size) break;
+      z->avail_in = (gz.size - in > (1L << 30) ? (1L << 30) : gz.size - in);
+    }
+    z->next_out  = buf + got;
+    z->avail_out = before = len - got;
+    ret = inflate(z, Z_NO_FLUSH);
+    got += before - z->avail_out;
+    if (ret == Z_STREAM_END) {
+      in = z->next_in - gz.mem + (gz.raw ? 8 : 0); // trailer not read raw
+      gz.live = gz_member(in);
+      z->next_in  = (unsigned char *)gz.mem + in;
+      z->avail_in = 0;
+      inflateReset2(z, 47);
+      gz.raw = 0;
+    } else if (ret != Z_OK) {
+      gz.live = 0;
+    }
+  }
+  gz.at += got;
+  return got;
+}
+
+/* pcache fill: decodes from the checkpoint before `page`, or goes on from
+   where the last fill stopped when that's closer */
+static void gz_fill(void *arg, long page, int n, unsigned char **bufs,
+  char *ok)
+{
+  static unsigned char skip[1 << 16];
+  long start = page * PC_PAGE;
+  int lo = 0, hi = gz.n;
+
+  while (lo < hi) { // last checkpoint at or before start
+    int mid = (lo + hi) / 2;
+    if (gz.p[mid].out <= start) lo = mid + 1; else hi = mid;
+  }
+  if (!gz.live || gz.at > start || gz.at < gz.p[lo - 1].out)
+    gz_seek(lo - 1);
+  while (gz.live && gz.at < start)
+    if (gz_read(skip, (start - gz.at < (long)sizeof(skip) ?
+        start - gz.at : (long)sizeof(skip))) == 0)
+      break;
+  for (int i = 0; i < n && gz.live && gz.at == start + (long)i*PC_PAGE; i++) {
+    long got = gz_read(bufs[i], PC_PAGE);
+    if (got == 0) break;
+    memset(bufs[i] + got, 0, PC_PAGE - got);
+    ok[i] = 1;
+  }
+}
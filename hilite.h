@@ -0,0 +1,213 @@
+// coloured byte ranges drawn over the view. Spans live in one array sorted
+// by start that doubles as an implicit interval tree: every element keeps
+// the highest end of the subtree under it, so the spans overlapping the
+// visible window are found in O(log n + k). Rows then get their colour
+// runs from those few spans only.
+#define HL_VISMAX 512
+
+enum { // higher layers win where spans overlap
+  HL_HOLE = 0,
+  HL_TMPL,
+  HL_MAGIC,
+  HL_NOTE,
+  HL_FIND
+};
+
+typedef struct span {
+  long start, end;   // [start, end)
+  long max;          // highest end under this node
+  unsigned int color;
+  int  layer;
+  long data;         // for the owner of the layer
+} span;
+
+typedef struct hlrun {
+  int from, to;      // [from, to) within the row
+  unsigned int color;
+} hlrun;
+
+typedef struct hlnode { // hl_window() walk: node, level, left side done
+  long x;
+  int  k, w;
+} hlnode;
+
+static struct {
+  span *s;
+  long  n, cap;
+  int   dirty;       // unsorted, the index needs building
+  int   levels;
+  span *vis[HL_VISMAX]; // overlapping the window, by start
+  int   nvis;
+} hl = { .levels = -1 };
+
+static int hl_cmp(const void *a, const void *b)
+{
+  const span *x = a, *y = b;
+  return (x->start > y->start) - (x->start < y->start);
+}
+
+static int hl_add(long start, long end, int layer, unsigned int color,
+  long data)
+{
+  if (start >= end) return 0;
+  if (hl.n == hl.cap) {
+    span *s = realloc(hl.s, sizeof(span) * (hl.cap = hl.cap*2 + 64));
+    if (s == NULL) return -1;
+    hl.s = s;
+  }
+  hl.s[hl.n++] = (span){ start, end, end, color, layer, data };
+  hl.dirty = 1;
+  return 0;
+}
+
+static void hl_clear(int layer)
+{
+  long k = 0;
+
+  for (long i = 0; i < hl.n; i++)
+    if (hl.s[i].layer != layer) hl.s[k++] = hl.s[i];
+  if (k != hl.n) hl.dirty = 1;
+  hl.n = k;
+}
+
+static void hl_remove(int layer, long data)
+{
+  long k = 0;
+
+  for (long i = 0; i < hl.n; i++)
+    if (hl.s[i].layer != layer || hl.s[i].data != data) hl.s[k++] = hl.s[i];
+  if (k != hl.n) hl.dirty = 1;
+  hl.n = k;
+}
+
+/* sorts and fills in the subtree maxima: in-order layout, a node at level
+   k sits at an index with k trailing ones */
+static void hl_index(void)
+{
+  span *a = hl.s;
+  long n = hl.n, last_i = 0, last = 0;
+  int k;
+
+  hl.dirty = 0;
+  if (n == 0) { hl.levels = -1; return; }
+  qsort(a, n, sizeof(span), hl_cmp);
+  for (long i = 0; i < n; i += 2) {
+    last_i = i;
+    last = a[i].max = a[i].end;
+  }
+  for (k = 1; 1L << k <= n; k++) {
+    long x = 1L << (k-1), step = x << 2;
+    for (long i = (x << 1) - 1; i < n; i += step) {
+      long el = a[i - x].max, er = (i + x < n ? a[i + x].max : last),
+           e = a[i].end;
+      if (el > e) e = el;
+      if (er > e) e = er;
+      a[i].max = e;
+    }
+    last_i = (last_i >> k & 1 ? last_i - x : last_i + x);
+    if (last_i < n && a[last_i].max > last) last = a[last_i].max;
+  }
+  hl.levels = k - 1;
+}
+
+/* up to `max` spans overlapping [off, off+len) into `out`, by start */
+static int hl_query(long off, long len, span **out, int max)
+{
+  hlnode stack[64];
+  long end = off + len, n = hl.n;
+  span *a = hl.s;
+  int t = 0, k = 0;
+
+  if (hl.dirty) hl_index();
+  if (hl.levels < 0) return 0;
+  stack[t++] = (hlnode){ (1L << hl.levels) - 1, hl.levels, 0 };
+  while (t > 0) {
+    hlnode z = stack[--t];
+    if (z.k <= 3) { // small subtree, just scan it
+      long i0 = z.x >> z.k << z.k, i1 = i0 + (1L << (z.k+1)) - 1;
+      if (i1 > n) i1 = n;
+      for (long i = i0; i < i1 && a[i].start < end; i++)
+        if (off < a[i].end && k < max)
+          out[k++] = &a[i];
+    } else if (z.w == 0) { // left subtree first
+      long y = z.x - (1L << (z.k-1));
+      stack[t++] = (hlnode){ z.x, z.k, 1 };
+      if (y >= n || a[y].max > off)
+        stack[t++] = (hlnode){ y, z.k-1, 0 };
+    } else if (z.x < n && a[z.x].start < end) {
+      if (off < a[z.x].end && k < max)
+        out[k++] = &a[z.x];
+      stack[t++] = (hlnode){ z.x + (1L << (z.k-1)), z.k-1, 0 };
+    }
+  }
+  return k;
+}
+
+/* the spans of the visible window into `hl.vis`, once per frame */
+static void hl_window(long off, long len)
+{
+  hl.nvis = hl_query(off, len, hl.vis, HL_VISMAX);
+}
+
+/* first span of `layer` starting after `off` (dir > 0) or before it */
+static span *hl_next(int layer, long off, int dir)
+{
+  long lo = 0, hi;
+
+  if (hl.dirty) hl_index();
+  hi = hl.n;
+  while (lo < hi) { // first start > off
+    long mid = (lo + hi) / 2;
+    if (hl.s[mid].start <= off) lo = mid + 1; else hi = mid;
+  }
+  if (dir > 0) {
+    for (; lo < hl.n; lo++)
+      if (hl.s[lo].layer == layer) return &hl.s[lo];
+  } else {
+    for (lo--; lo >= 0; lo--)
+      if (hl.s[lo].layer == layer && hl.s[lo].start < off) return &hl.s[lo];
+  }
+  return NULL;
+}
+
+/* colour runs of the row [off, off+n) from the visible spans, where they
+   overlap the highest layer wins, then the one starting last. Returns the
+   amount of runs, at most `n` */
+static int hl_row(long off, int n, hlrun *runs)
+{
+  int b[HL_VISMAX*2 + 2], nb = 0, nruns = 0;
+
+  if (hl.nvis == 0) return 0;
+  b[nb++] = 0;
+  b[nb++] = n;
+  for (int i = 0; i < hl.nvis; i++) {
+    span *s = hl.vis[i];
+    if (s->start >= off + n || s->end <= off) continue;
+    if (s->start > off) b[nb++] = s->start - off;
+    if (s->end < off + n) b[nb++] = s->end - off;
+  }
+  for (int i = 1; i < nb; i++) // few of them, insertion sort
+    for (int j = i; j > 0 && b[j-1] > b[j]; j--) {
+      int tmp = b[j]; b[j] = b[j-1]; b[j-1] = tmp;
+    }
+
+  for (int i = 0; i + 1 < nb; i++) {
+    long from = off + b[i];
+    span *best = NULL;
+    if (b[i] == b[i+1]) continue;
+    for (int j = 0; j < hl.nvis; j++) {
+      span *s = hl.vis[j];
+      if (s->start > from || s->end <= from) continue;
+      if (best == NULL || s->layer > best->layer ||
+          (s->layer == best->layer && s->start >= best->start))
+        best = s;
+    }
+    if (best == NULL) continue;
+    if (nruns > 0 && runs[nruns-1].to == b[i] &&
+        runs[nruns-1].color == best->color)
+      runs[nruns-1].to = b[i+1];
+    else
+      runs[nruns++] = (hlrun){ b[i], b[i+1], best->color };
+  }
+  return nruns;
+}
@@ -0,0 +1,209 @@
+// background jobs: a job is split in chunks that a set of workers run.
+// Each worker owns a deque of chunk ranges, takes chunks from the front of
+// its own and steals the back half of someone else's when it runs dry.
+// When the last chunk of a job is done `notify` is called from that worker
+// so the result can be handed to the ui thread.
+#include <pthread.h>
+
+#define JOBS_MAX 64
+
+typedef struct job job;
+struct job {
+  const char *name;   // for the infobar
+  long nchunks;
+  long done;          // chunks finished (or skipped once cancelled)
+  int  cancel;        // cancellation token, see job_cancelled()
+  void (*run)(job *j, long chunk);
+  void (*deliver)(job *j);  // on the ui thread, after the last chunk
+  int  (*progress)(job *j); // for jobs of one long chunk, NULL otherwise
+  void *arg;
+  unsigned gen;       // of the query it answers, older ones aren't shown
+};
+
+typedef struct jobrange {
+  job *j;
+  long lo, hi;
+} jobrange;
+
+typedef struct jobqueue {
+  pthread_mutex_t lock;
+  jobrange *r;
+  int n, cap;
+} jobqueue;
+
+static struct {
+  int n;
+  pthread_t tid[JOBS_MAX];
+  jobqueue  q[JOBS_MAX];
+  unsigned posted;    // ranges pushed for the idle to look at, see below
+  pthread_mutex_t idle_lock;
+  pthread_cond_t  idle;
+  void (*notify)(job *j);
+} jobs = {
+  .idle_lock = PTHREAD_MUTEX_INITIALIZER,
+  .idle      = PTHREAD_COND_INITIALIZER
+};
+
+static int job_cancelled(job *j)
+{
+  return __atomic_load_n(&j->cancel, __ATOMIC_RELAXED);
+}
+
+static void job_cancel(job *j)
+{
+  __atomic_store_n(&j->cancel, 1, __ATOMIC_RELAXED);
+}
+
+/* percentage of chunks done */
+static int job_progress(job *j)
+{
+  if (j->progress != NULL) return j->progress(j);
+  return __atomic_load_n(&j->done, __ATOMIC_RELAXED) * 100 / j->nchunks;
+}
+
+/* caller holds q->lock */
+static int jobqueue_push(jobqueue *q, jobrange r)
+{
+  if (q->n == q->cap) {
+    jobrange *n = realloc(q->r, sizeof(jobrange) * (q->cap = q->cap*2 + 8));
+    if (n == NULL) return -1;
+    q->r = n;
+  }
+  q->r[q->n++] = r;
+  return 0;
+}
+
+static int jobs_take(int self, jobrange *c)
+{
+  jobqueue *q = &jobs.q[self];
+  int got = 0;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->n > 0) {
+    *c = (jobrange){ q->r[0].j, q->r[0].lo, q->r[0].lo + 1 };
+    if (++q->r[0].lo == q->r[0].hi)
+      memmove(q->r, q->r + 1, sizeof(jobrange) * --q->n);
+    got = 1;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return got;
+}
+
+/* runs the chunks of a range and tells when the last of a job is done */
+static void jobs_run(jobrange c)
+{
+  for (long k = c.lo; k < c.hi; k++) {
+    if (!job_cancelled(c.j))
+      c.j->run(c.j, k);
+    if (__atomic_add_fetch(&c.j->done, 1, __ATOMIC_ACQ_REL) == c.j->nchunks)
+      jobs.notify(c.j);
+  }
+}
+
+/* wakes the workers, which sleep until `posted` moves from what it was
+   before they found every deque empty */
+static void jobs_post(int all)
+{
+  pthread_mutex_lock(&jobs.idle_lock);
+  jobs.posted++;
+  if (all)
+    pthread_cond_broadcast(&jobs.idle);
+  else
+    pthread_cond_signal(&jobs.idle);
+  pthread_mutex_unlock(&jobs.idle_lock);
+}
+
+/* half of the last range of a victim, runs one chunk and keeps the rest
+   (or runs it all when the rest can't be kept) */
+static int jobs_steal(int self, jobrange *c)
+{
+  for (int i = 1; i < jobs.n; i++) {
+    jobqueue *v = &jobs.q[(self + i) % jobs.n];
+    jobrange s;
+
+    pthread_mutex_lock(&v->lock);
+    if (v->n == 0) {
+      pthread_mutex_unlock(&v->lock);
+      continue;
+    }
+    s = v->r[v->n - 1];
+    if (s.hi - s.lo > 1) {
+      s.lo = s.lo + (s.hi - s.lo)/2;
+      v->r[v->n - 1].hi = s.lo;
+    } else {
+      v->n--;
+    }
+    pthread_mutex_unlock(&v->lock);
+
+    *c = (jobrange){ s.j, s.lo, s.lo + 1 };
+    if (++s.lo < s.hi) {
+      int r;
+      pthread_mutex_lock(&jobs.q[self].lock);
+      r = jobqueue_push(&jobs.q[self], s);
+      pthread_mutex_unlock(&jobs.q[self].lock);
+      if (r == -1)
+        c->hi = s.hi;
+      else
+        jobs_post(0); // more to steal for an idle one
+    }
+    return 1;
+  }
+  return 0;
+}
+
+static void *jobs_worker(void *p)
+{
+  int self = (long)p;
+  jobrange c;
+
+  for (;;) {
+    unsigned seen = __atomic_load_n(&jobs.posted, __ATOMIC_ACQUIRE);
+    if (jobs_take(self, &c) || jobs_steal(self, &c)) {
+      jobs_run(c);
+      continue;
+    }
+    pthread_mutex_lock(&jobs.idle_lock);
+    while (jobs.posted == seen)
+      pthread_cond_wait(&jobs.idle, &jobs.idle_lock);
+    pthread_mutex_unlock(&jobs.idle_lock);
+  }
+  return NULL;
+}
+
+static int jobs_init(int threads, void (*notify)(job *j))
+{
+  jobs.notify = notify;
+  if (threads > JOBS_MAX) threads = JOBS_MAX;
+  for (int i = 0; i < threads; i++)
+    pthread_mutex_init(&jobs.q[i].lock, NULL);
+  for (jobs.n = 0; jobs.n < threads; jobs.n++)
+    if (pthread_create(&jobs.tid[jobs.n], NULL, jobs_worker,
+        (void *)(long)jobs.n) != 0)
+      break;
+  return (jobs.n > 0 ? 0 : -1);
+}
+
+/* spreads the chunks over every worker, `j` must live until delivered. A
+   range no deque has room for is run by the caller */
+static void job_submit(job *j)
+{
+  long per = (j->nchunks + jobs.n - 1) / jobs.n;
+  jobrange left[JOBS_MAX];
+  int nleft = 0;
+
+  j->done = j->cancel = 0;
+  if (j->nchunks == 0) {
+    jobs.notify(j);
+    return;
+  }
+  for (int i = 0; i < jobs.n && i*per < j->nchunks; i++) {
+    jobrange r = { j, i*per, (i+1)*per < j->nchunks ? (i+1)*per : j->nchunks };
+    pthread_mutex_lock(&jobs.q[i].lock);
+    if (jobqueue_push(&jobs.q[i], r) == -1)
+      left[nleft++] = r;
+    pthread_mutex_unlock(&jobs.q[i].lock);
+  }
+  jobs_post(1);
+  for (int i = 0; i < nleft; i++)
+    jobs_run(left[i]);
+}
@@ -136,3 +136,30 @@ static magic find_magic(const char *s, long size)
   return m;
 }
 
+/* an embedded file: the first magic from `i` on that has a footer and its
+   header at `off`, -1 when there's none. The file ends at the first of its
+   footers after the header, found by the caller (see extract.h), else the
+   next magic is tried */
+static int carve_magic(const char *s, long size, long off, int i)
+{
+  for (; magics[i].suffix != NULL; i++) {
+    magic *m = &magics[i];
+    if (m->footer != NULL && m->hdr_pos == 0 && off + m->hdr_len <= size &&
+        memcmp(s + off, m->header, m->hdr_len) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/* where the file ends whose footer ends at `end`, `after` holds the n
+   bytes (18 at most) that follow it */
+static long carve_end(const magic *m, long end, const unsigned char *after,
+  int n, long size)
+{
+  if (strcmp(m->suffix, "png") == 0) { // the crc of IEND
+    end += 4;
+  } else if (strcmp(m->suffix, "zip") == 0 && n >= 18) { // comment
+    end += 18 + (after[16] | after[17] << 8);
+  }
+  return (end > size ? size : end);
+}
@@ -1,25 +1,71 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <assert.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <limits.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 
 #include "magic.h"
 #include "font.h"
+#include "format.h"
+#include "dump.h"
+#include "pool.h"
+#include "crc32.h"
+#include "edit.h"
+#include "patch.h"
+#include "ups.h"
+#include "jobs.h"
+#include "extract.h"
+#include "fixsum.h"
+#include "extents.h"
+#include "search.h"
+#include "strs.h"
+#include "regex.h"
+#include "prof.h"
+#include "replay.h"
+#include "hilite.h"
+#include "sidecar.h"
+#include "notes.h"
+#include "tmpl.h"
+#include "vaddr.h"
+#include "pcache.h"
+#include "procmem.h"
+#include "gzseek.h"
+#include "ngram.h"
+#include "values.h"
+#include "resident.h"
 
 #define TO_SDL_COLOR(c)  ((SDL_Color){c>>16,c>>8 & 0xff,c&0xff})
 
 enum {
   CMD_NONE = 0,
   CMD_INPUT,
-  CMD_GO
+  CMD_GO,
+  CMD_FIND,
+  CMD_NOTE,
+  CMD_VGO,
+  CMD_STRINGS,
+  CMD_REGEX,
+  CMD_VALUE
+};
+
+enum {
+  MODE_GUI = 0,
+  MODE_DUMP,
+  MODE_UNDUMP,
+  MODE_PATCH,
+  MODE_APPLY,
+  MODE_EXTRACT,
+  MODE_STRINGS,
+  MODE_INDEX
 };
 
 struct Theme {
-  unsigned int bgcolor, fgcolor, ngcolor, mgcolor;
+  unsigned int bgcolor, fgcolor, ngcolor, mgcolor, hlcolor, ntcolor, stcolor;
   int   font_size;
   char *font_name;
 } theme = { // customize
@@ -27,6 +73,9 @@ struct Theme {
   .fgcolor   = 0xDFDFDF, // foreground
   .ngcolor   = 0xDE8972, // special
   .mgcolor   = 0x71C6DE, // magic
+  .hlcolor   = 0xDED472, // found
+  .ntcolor   = 0x9DDE72, // notes
+  .stcolor   = 0x9A9A9A, // every other field of a structure
   .font_size = 11
 };
 
@@ -36,6 +85,8 @@ struct Win {
   SDL_Rect content;
   SDL_Rect asciicol;
   SDL_Rect infobar;
+  SDL_Rect strip;   // page cache residency of the whole file
+  int offdigits;    // of the offset column, addresses take more
   int rows, cols, colsize;
   int amount;
   int curpos;
@@ -52,6 +103,9 @@ struct Doc {
   long  fsize, fpos, foff;
   int ro;
   char *fdmem;
+  pcache *pc;   // what can't be mapped goes through the page cache
+  edit  ed;
+  long  holes_at; // ed.nlog when the holes were read, -1 not yet
   // format magic
   magic magic;
   char  has_footer;
@@ -61,40 +115,147 @@ struct Doc {
   .magic = {NULL}
 };
 
+static pcache cache;
+static gzjob *gzbuild; // the index of a gzip file being built
+static long gzpos;     // where the other view of it was left
+static ngjob *ngbuild; // the search index being built
+static job   *resjob;  // what's resident, taken when the strip is shown
+static fixsum *sums;   // stale checksums of the journal as of sums->nlog
+static int sumsbusy;   // being found
+static int sumsfix;    // fixed once found, else only counted
+
 SDL_Window *window;
 SDL_Surface *screen;
 SDL_Renderer *renderer;
 TTF_Font *font;
 
+// every printable character rendered once in white, tinted when drawn
+static struct {
+  SDL_Texture *tex;
+  int w, h;
+} glyphs[0x80];
+
 static char dot[8] = {0x00, 0x00, 0x18, 0x3c, 0x3c, 0x18, 0x00, 0x00};
 
 static int dragging, drag_mx, drag_my;
 static int currcmd;
 static int spaces;
 static char input[4];
+static char message[64]; // shown in the infobar until the next key
+static char findbuf[32];  // hex digits of the pattern being typed
+static int  findlen;
+static unsigned char lastpat[16];
+static int  lastlen;
+// search as you type: every change of the pattern cancels the search of
+// the one before and starts over from where the command was opened; what
+// a search of an older generation finds is dropped
+static job     *incjob;    // the search of the pattern as typed
+static int      inckind;   // CMD_FIND, CMD_REGEX or CMD_VALUE
+static unsigned incgen;
+static job     *srchjob;   // the newest search, typed or not
+static int      incdone;   // incjob was delivered
+static long     incfrom;   // cursor when the command was opened
+static long     incshown = -1; // end of the hit of incjob on screen
+static char notebuf[64];  // text of the note being typed
+static int  notelen;
+static long anchor = -1;  // other end of the next note
+static int  overlay = 1;  // structure templates shown
+static int  vamode;       // offsets as virtual addresses
+static char vabuf[16];    // hex digits of the address being typed
+static int  valen;
+static char sfbuf[64];    // text the strings are filtered by, being typed
+static int  sflen;
+static char sflast[64];
+static int  sflastlen;
+static char rebuf[128];   // regular expression being typed
+static int  relen;
+static char relast[128];
+static int  relastlen;
+static char numbuf[64];   // value being typed, see values.h
+static int  numlen;
+static char numlast[64];
+static int  numlastlen;
+static strjob *strbuild;  // the index of the strings being built
+static int  strthen;      // what it's for: 1/-1 a jump, 2 the filter
+static long strsat = -1;  // doc.ed.nlog the index is of
+static long strbuildat;   // and the one being built
+static strfind *strfinding; // reading the index
+
+// background jobs, delivered back through `jobevent`
+#define ACTIVE_MAX 8
+static job   *active[ACTIVE_MAX];
+static int    nactive;
+static Uint32 jobevent;
 
 static void get_font_width(void);
 static long input_to_long(char *s);
 static int isasciihex(char c);
-static void toasciihex(unsigned char s, char *d);
 static void off_toasciihex(int off, char *d);
-static char toprintable(char s);
 static void go(long off);
 static void quit(int code, const char *m);
+static void escape_bytes(const unsigned char *s, int size, char *d);
 static void copy_bytes(int size);
+static void export_patch(void);
+static void sums_done(job *j);
+static void sums_start(int fix);
+static void extract_range(void);
+static void job_notify(job *j);
+static void job_start(job *j);
+static void job_finish(job *j);
+static void search_bump(void);
+static void search_start(job *j, int typed);
+static int search_current(job *j);
+static void inc_search(void);
+static void inc_cancel(void);
+static void inc_show(void);
+static void find_done(job *j);
+static void find_from(const unsigned char *pat, int len, long from,
+  int typed);
+static void start_find(void);
+static void index_done(job *j);
+static void start_index(void);
+static void strings_done(job *j);
+static void start_strings(int then);
+static void strings_jump(int dir);
+static void strfind_done(job *j);
+static void start_strfind(void);
+static void regex_done(job *j);
+static const char *regex_from(const char *pat, int len, long from,
+  int typed);
+static void start_regex(void);
+static void value_done(job *j);
+static const char *value_from(const char *q, int len, long from, int typed);
+static void start_value(void);
+static void va_go(void);
+static void note_commit(void);
+static void note_jump(int dir);
 static void mouse_set_cursor(int x, int y);
 static void grab_input(char c);
 static void draw_bitmap(char *s, int x, int y, unsigned int f);
 static void draw_background(void);
+static void init_glyphs(void);
+static void draw_glyphs(const char *s, int n, int x, int y, unsigned int color);
 static void draw_text(char *s, int x, int y, unsigned int color);
 static void draw_cursor(int x, int y, unsigned int b, unsigned int f, int size);
 static void draw_infobar(void);
+static void draw_hud(void);
 static void draw_offsetcol(void);
-static void draw_ascii(char s, int x, int row, char cursor, char special);
+static void draw_strip(void);
+static void res_done(job *j);
+static void res_toggle(void);
+static const unsigned char *doc_view(long off, long len);
 static void init_content(void);
+static void init_holes(void);
+static void init_process(pid_t pid);
+static void gz_start(void);
+static void gz_view(int decoded);
 static void show_content(void);
+static char *cmd_text(int **len, int *size);
 static void drag_window(void);
+static void handle_event(SDL_Event *e);
 static void running(void);
+static void win_layout(void);
+static void init_window(void);
 
 static void get_font_width(void) /* just using uppercase letters */
 {
@@ -124,11 +285,9 @@ static long input_to_long(char *s) {
   }
   return r;
 }
-static void toasciihex(unsigned char s, char *d) { snprintf(d, 3, "%02X", s); }
 static void off_toasciihex(int off, char *d) {
   snprintf(d, 5,"%04X", off & 0xffff);
 }
-static char toprintable(char s) { return (s < 0x20 || s > 0x7e) ? '.' : s; }
 static void go(long off)
 {
   long base = off - (off%win.amount);
@@ -149,35 +308,624 @@ static void quit(int code, const char *m)
       fprintf(stderr, "SDL error: %s\n", err);
     }
   }
+  prof_trace_close();
+  if (replay.rec != NULL) {
+    fclose(replay.rec);
+    replay_report(stderr);
+  }
   if (font != NULL) TTF_CloseFont(font);
   if (renderer != NULL) SDL_DestroyRenderer(renderer);
   if (window != NULL) SDL_DestroyWindow(window);
   if (doc.fd != -1) {
-    munmap(doc.fdmem, doc.fsize);
+    if (doc.fdmem != NULL) munmap(doc.fdmem, doc.ed.size);
+    if (doc.ed.nlog > 0) notes_touch(); // the mtime is final once unmapped
     close(doc.fd);
   }
   exit(code);
 }
 
+static void escape_bytes(const unsigned char *s, int size, char *d)
+{
+  for (int i = 0; i < size; i++, d += 4) { // \xNN
+    d[0] = '\\'; d[1] = 'x';
+    fmt_hex(s + i, d + 2, 1);
+  }
+  *d = '\0';
+}
+
 static void copy_bytes(int size) /* TODO: `X` should ask for amount of bytes */
 {
   int len = (size*4)+1;
   char *hex = malloc(len);
-  unsigned char *ptr = (unsigned char *)(doc.fdmem + doc.fpos + win.curpos);
+  const unsigned char *ptr;
 
   if (hex == NULL) {
     perror("malloc"); return;
   }
-  memset(hex, '\0', len);
-
-  for (int i = 0;i < size; i++) {
-    char tmp[5];
-    snprintf(tmp, 5, "\\x%02X", *(ptr+i));
-    strcat(hex, tmp);
+  if (size > doc.fsize - (doc.fpos + win.curpos))
+    size = doc.fsize - (doc.fpos + win.curpos);
+  if ((ptr = doc_view(doc.fpos + win.curpos, size)) == NULL) {
+    free(hex); return;
   }
+  escape_bytes(ptr, size, hex);
   int r = SDL_SetClipboardText(hex);
   if (r == -1)
     fprintf(stderr, "SDL error: %s\n", SDL_GetError());
+  free(hex);
+}
+
+static void sums_report(void)
+{
+  if (sums->err != 0) {
+    snprintf(message, sizeof(message), "checksums: %s", strerror(sums->err));
+  } else if (!sumsfix) {
+    if (sums->stale > 0)
+      snprintf(message, sizeof(message), "%d stale sums, s fixes them",
+        sums->stale);
+    return; // kept for s, while the journal stays as it is
+  } else if (sums->stale > 0) {
+    fix_apply(sums);
+    snprintf(message, sizeof(message), "%d checksums fixed", sums->stale);
+  } else {
+    snprintf(message, sizeof(message), "checksums fine");
+  }
+  fix_free(sums);
+  sums = NULL;
+}
+
+static void sums_done(job *j)
+{
+  sumsbusy = 0;
+  if (job_cancelled(j) || sums->nlog != doc.ed.nlog) {
+    fix_free(sums);
+    sums = NULL;
+    if (!job_cancelled(j)) sums_start(sumsfix); // edited meanwhile, again
+    return;
+  }
+  sums_report();
+}
+
+/* finds the checksums the session's edits left stale, and fixes them */
+static void sums_start(int fix)
+{
+  if (sumsbusy) {
+    sumsfix |= fix;
+    return;
+  }
+  sumsfix = fix;
+  if (sums != NULL && sums->nlog == doc.ed.nlog) { // counted already
+    sums_report();
+    return;
+  }
+  fix_free(sums);
+  if ((sums = fix_new(&doc.ed, sums_done)) == NULL) {
+    if (errno != 0)
+      snprintf(message, sizeof(message), "checksums: %s", strerror(errno));
+    else if (fix)
+      snprintf(message, sizeof(message), "checksums fine");
+    return;
+  }
+  sumsbusy = 1;
+  job_start(&sums->j);
+}
+
+static void export_patch(void) /* session edits to `<file>.ups` */
+{
+  char path[PATH_MAX];
+  long n;
+
+  snprintf(path, sizeof(path), "%s.ups", doc.filepath);
+  if ((n = ups_export(&doc.ed, path)) == -1) {
+    perror(path);
+    snprintf(message, sizeof(message), "patch: %s", strerror(errno));
+    return;
+  }
+  snprintf(message, sizeof(message), "%ld bytes to .ups", n);
+  sums_start(0); // stale ones are told once found
+}
+
+static void extract_done(job *j)
+{
+  xjob *x = (xjob *)j;
+
+  if (x->err != 0) {
+    snprintf(message, sizeof(message), "extract: %s", strerror(x->err));
+  } else if (x->len == 0 && !job_cancelled(j)) {
+    snprintf(message, sizeof(message), "no file starts here, M marks one");
+  } else if (!job_cancelled(j)) {
+    anchor = -1;
+    snprintf(message, sizeof(message), "%ld bytes to %s%s", x->len,
+      x->path + strlen(doc.filepath), (x->r == EXTRACT_REFLINK ?
+      ", shared" : ""));
+  }
+  free(x);
+}
+
+/* M to the cursor, or the embedded file whose header is at the cursor, to
+   `<file>.<offset>.<suffix>` by a job */
+static void extract_range(void)
+{
+  char path[PATH_MAX];
+  long pos = doc.fpos + win.curpos, start = pos, len = 0;
+  int m = -1;
+  xjob *x;
+
+  if (doc.fdmem == NULL || doc.pc != NULL) {
+    snprintf(message, sizeof(message), "nothing to extract");
+    return;
+  }
+  if (anchor != -1) {
+    start = (anchor < pos ? anchor : pos);
+    len   = (anchor < pos ? pos : anchor) + 1 - start;
+  } else if ((m = carve_magic(doc.fdmem, doc.fsize, pos, 0)) == -1) {
+    snprintf(message, sizeof(message), "no file starts here, M marks one");
+    return;
+  }
+  snprintf(path, sizeof(path), "%s.%lx.%s", doc.filepath, start,
+    (m == -1 ? "bin" : ""));
+  if ((x = extract_new(doc.fd, doc.fsize, start, len, m, path,
+      extract_done)) == NULL) {
+    snprintf(message, sizeof(message), "extract: %s", strerror(errno));
+    return;
+  }
+  job_start(&x->j);
+}
+
+static void job_notify(job *j) /* from a worker thread */
+{
+  SDL_Event e;
+
+  memset(&e, 0, sizeof(e));
+  e.type = jobevent;
+  e.user.data1 = j;
+  SDL_PushEvent(&e);
+}
+
+static void job_start(job *j)
+{
+  if (nactive == ACTIVE_MAX) {
+    snprintf(message, sizeof(message), "too many jobs");
+    job_cancel(j);
+    j->deliver(j);
+    return;
+  }
+  active[nactive++] = j;
+  job_submit(j);
+}
+
+static void job_finish(job *j)
+{
+  for (int i = 0; i < nactive; i++) {
+    if (active[i] != j) continue;
+    memmove(active + i, active + i + 1, sizeof(job *) * (--nactive - i));
+    break;
+  }
+  if (nactive == 0) ext_reclaim(); // no worker reads an old table now
+  j->deliver(j);
+}
+
+/* a newer pattern or search: the one in flight won't be shown */
+static void search_bump(void)
+{
+  if (srchjob != NULL) job_cancel(srchjob);
+  srchjob = NULL;
+  incgen++;
+}
+
+static void search_start(job *j, int typed)
+{
+  search_bump();
+  j->gen  = incgen;
+  srchjob = j;
+  if (typed) {
+    incjob  = j;
+    inckind = currcmd;
+  }
+  job_start(j);
+}
+
+/* 1 when what a search found is to be shown: it wasn't cancelled nor has
+   a newer pattern been typed since */
+static int search_current(job *j)
+{
+  int cur = (!job_cancelled(j) && j->gen == incgen);
+
+  if (j == srchjob) srchjob = NULL;
+  if (j == incjob) {
+    incjob  = NULL;
+    incdone = cur;
+  }
+  return cur;
+}
+
+/* the pattern being typed changed, its search replaces the one before */
+static void inc_search(void)
+{
+  unsigned char pat[sizeof(lastpat)];
+
+  if (currcmd == CMD_FIND && findlen % 2 != 0) return; // half a byte
+  search_bump();
+  incjob   = NULL;
+  incdone  = 0;
+  incshown = -1;
+  hl_clear(HL_FIND);
+  go(incfrom);
+  if (doc.fdmem == NULL || doc.pc != NULL) return;
+  if (currcmd == CMD_FIND && findlen > 0) {
+    fmt_unhex(findbuf, pat, findlen/2);
+    find_from(pat, findlen/2, incfrom + 1, 1);
+  } else if (currcmd == CMD_REGEX && relen > 0) {
+    regex_from(rebuf, relen, incfrom + 1, 1); // incomplete ones don't parse
+  } else if (currcmd == CMD_VALUE && numlen > 0) {
+    value_from(numbuf, numlen, incfrom + 1, 1);
+  }
+}
+
+static void inc_cancel(void) /* back to where the command was opened */
+{
+  if (incjob == NULL && !incdone) return;
+  search_bump();
+  incjob  = NULL;
+  incdone = 0;
+  hl_clear(HL_FIND);
+  go(incfrom);
+}
+
+/* the hit of the search being typed as soon as a chunk has one, every
+   frame: a lower one may still come from the chunks before */
+static void inc_show(void)
+{
+  long at, end;
+
+  if (incjob == NULL) return;
+  if (inckind == CMD_FIND) {
+    findjob *f = (findjob *)incjob;
+    if ((at = __atomic_load_n(&f->best, __ATOMIC_RELAXED)) == LONG_MAX)
+      return;
+    end = at + f->len;
+  } else if (inckind == CMD_VALUE) {
+    valjob *v = (valjob *)incjob;
+    char name[64];
+    if ((at = __atomic_load_n(&v->best, __ATOMIC_RELAXED)) == LONG_MAX)
+      return;
+    end = at + val_name(v, at, name, sizeof(name));
+  } else {
+    rejob *r = (rejob *)incjob;
+    if ((end = __atomic_load_n(&r->best, __ATOMIC_RELAXED)) == LONG_MAX ||
+        end == incshown ||
+        (at = re_start(r->re, r->mem, re_from(r, end), end)) == -1)
+      return;
+  }
+  if (end == incshown) return;
+  incshown = end;
+  hl_clear(HL_FIND);
+  hl_add(at, end, HL_FIND, theme.hlcolor, 0);
+  go(at);
+}
+
+static void find_done(job *j)
+{
+  findjob *f = (findjob *)j;
+
+  if (search_current(j)) {
+    hl_clear(HL_FIND);
+    if (f->best != LONG_MAX) {
+      hl_add(f->best, f->best + f->len, HL_FIND, theme.hlcolor, 0);
+      go(f->best);
+    } else
+      snprintf(message, sizeof(message), "not found");
+  }
+  free(f->cand);
+  free(f);
+}
+
+static void find_from(const unsigned char *pat, int len, long from,
+  int typed)
+{
+  findjob *f = find_new(doc.fdmem, doc.fsize, from, pat, len, find_done);
+
+  if (f == NULL) return;
+  if (doc.ed.nlog == 0) { // the index is of the file as it was opened
+    f->cand  = ng_candidates(pat, len);
+    f->block = NG_BLOCK;
+  }
+  search_start(&f->j, typed);
+}
+
+static void start_find(void) /* from the cursor on, empty repeats the last */
+{
+  if (doc.fdmem == NULL || doc.pc != NULL) {
+    snprintf(message, sizeof(message), "nothing to search");
+    return;
+  }
+  init_holes(); // edits may have filled some
+  if (findlen > 0) {
+    if (findlen % 2 != 0) {
+      snprintf(message, sizeof(message), "odd pattern");
+      return;
+    }
+    lastlen = findlen/2;
+    fmt_unhex(findbuf, lastpat, lastlen);
+    if (incjob != NULL || incdone) return; // searched as it was typed
+  }
+  find_from(lastpat, lastlen, doc.fpos + win.curpos + 1, 0);
+}
+
+static void index_done(job *j)
+{
+  ngbuild = NULL;
+  if (!job_cancelled(j)) {
+    if (ng_finish((ngjob *)j) == -1)
+      snprintf(message, sizeof(message), "index: %s", strerror(errno));
+    else
+      snprintf(message, sizeof(message), "index of %ld KiB, %d%% always read",
+        ngi.len >> 10, (int)(ng_full() * NG_BLOCK * 100 / doc.fsize));
+  } else {
+    ng_finish((ngjob *)j);
+  }
+  ng_free((ngjob *)j);
+}
+
+static void start_index(void) /* of a read only file, for / to skip blocks */
+{
+  if (doc.fdmem == NULL || doc.pc != NULL) {
+    snprintf(message, sizeof(message), "nothing to index");
+  } else if (!doc.ro) {
+    snprintf(message, sizeof(message), "the index is for read only files");
+  } else if (ngi.h != NULL) {
+    snprintf(message, sizeof(message), "already indexed");
+  } else if (ngbuild == NULL) {
+    if ((ngbuild = ng_new(doc.fdmem, doc.fsize, index_done)) == NULL)
+      snprintf(message, sizeof(message), "index: %s", strerror(errno));
+    else
+      job_start(&ngbuild->j);
+  }
+}
+
+static void strings_done(job *j) /* the index, then what it was built for */
+{
+  strjob *s = (strjob *)j;
+
+  strbuild = NULL;
+  if (!job_cancelled(j)) {
+    if (str_take(s) == -1) {
+      snprintf(message, sizeof(message), "strings: %s", strerror(errno));
+    } else {
+      strsat = strbuildat;
+      snprintf(message, sizeof(message), "%ld strings", strs.n);
+      if (strthen == 2) start_strfind(); else strings_jump(strthen);
+    }
+  }
+  str_free(s);
+}
+
+/* 1 when there's an index of the strings as they are now, one left stale
+   by edits is let go of to be built again */
+static int strings_fresh(void)
+{
+  if (strs.h != NULL && strsat != doc.ed.nlog && strfinding == NULL)
+    str_drop();
+  return (strs.h != NULL);
+}
+
+static void start_strings(int then)
+{
+  strthen = then;
+  if (strbuild != NULL) return;
+  strbuildat = doc.ed.nlog;
+  if ((strbuild = str_new(doc.fdmem, doc.fsize, strings_done)) == NULL) {
+    snprintf(message, sizeof(message), "no strings");
+    return;
+  }
+  job_start(&strbuild->j);
+}
+
+static void strings_jump(int dir) /* l and L, the first one indexes them */
+{
+  long i;
+
+  if (doc.fdmem == NULL || doc.pc != NULL) {
+    snprintf(message, sizeof(message), "strings are for the raw bytes");
+  } else if (!strings_fresh()) {
+    start_strings(dir);
+  } else if ((i = str_next(doc.fpos + win.curpos, dir)) == -1) {
+    snprintf(message, sizeof(message), "no more strings");
+  } else {
+    go(STR_OFF(strs.h[i]));
+  }
+}
+
+static void strfind_done(job *j)
+{
+  strfind *f = (strfind *)j;
+
+  strfinding = NULL;
+  if (!job_cancelled(j)) {
+    hl_clear(HL_FIND);
+    if (f->best != LONG_MAX) {
+      strhit h = strs.h[f->best];
+      hl_add(STR_OFF(h), STR_OFF(h) + STR_LEN(h), HL_FIND, theme.hlcolor, 0);
+      go(STR_OFF(h));
+    } else
+      snprintf(message, sizeof(message), "not found");
+  }
+  free(f);
+}
+
+/* the next string after the cursor with the text in it, empty repeats */
+static void start_strfind(void)
+{
+  strfind *f;
+  long i;
+
+  if (sflen > 0) {
+    memcpy(sflast, sfbuf, sflen);
+    sflastlen = sflen;
+  }
+  if (doc.fdmem == NULL || doc.pc != NULL) {
+    snprintf(message, sizeof(message), "strings are for the raw bytes");
+    return;
+  }
+  if (sflastlen == 0 || strfinding != NULL) return;
+  if (!strings_fresh()) {
+    start_strings(2);
+    return;
+  }
+  if ((i = str_next(doc.fpos + win.curpos, 1)) == -1 ||
+      (f = str_find_new(i, sflast, sflastlen, strfind_done)) == NULL) {
+    snprintf(message, sizeof(message), "not found");
+    return;
+  }
+  strfinding = f;
+  job_start(&f->j);
+}
+
+static void regex_done(job *j)
+{
+  rejob *r = (rejob *)j;
+  long start, end = r->best;
+
+  if (search_current(j)) {
+    hl_clear(HL_FIND);
+    if (end != LONG_MAX &&
+        (start = re_start(r->re, r->mem, re_from(r, end), end)) != -1) {
+      hl_add(start, end, HL_FIND, theme.hlcolor, 0);
+      go(start);
+    } else
+      snprintf(message, sizeof(message), "not found");
+  }
+  re_free(r->re);
+  free(r);
+}
+
+/* NULL once the search started, or why the pattern doesn't parse */
+static const char *regex_from(const char *pat, int len, long from,
+  int typed)
+{
+  const char *err = NULL;
+  regex *re;
+  rejob *r;
+
+  if ((re = re_new(pat, len, &err)) == NULL) return err;
+  if ((r = re_search(re, doc.fdmem, doc.fsize, from, regex_done)) == NULL)
+    re_free(re);
+  else
+    search_start(&r->j, typed);
+  return NULL;
+}
+
+/* from the cursor on like `/`, empty repeats the last one */
+static void start_regex(void)
+{
+  const char *err;
+
+  if (relen > 0) {
+    memcpy(relast, rebuf, relen);
+    relastlen = relen;
+    if (incjob != NULL || incdone) return; // searched as it was typed
+  }
+  if (doc.fdmem == NULL || doc.pc != NULL) {
+    snprintf(message, sizeof(message), "nothing to search");
+    return;
+  }
+  if (relastlen == 0) return;
+  init_holes();
+  if ((err = regex_from(relast, relastlen, doc.fpos + win.curpos + 1, 0)))
+    snprintf(message, sizeof(message), "regex: %s", err);
+}
+
+static void value_done(job *j)
+{
+  valjob *v = (valjob *)j;
+  int w;
+
+  if (search_current(j)) {
+    hl_clear(HL_FIND);
+    if (v->best != LONG_MAX &&
+        (w = val_name(v, v->best, message, sizeof(message))) > 0) {
+      hl_add(v->best, v->best + w, HL_FIND, theme.hlcolor, 0);
+      go(v->best);
+    } else
+      snprintf(message, sizeof(message), "not found");
+  }
+  free(v);
+}
+
+/* NULL once the search started, or what's wrong with the query */
+static const char *value_from(const char *q, int len, long from, int typed)
+{
+  const char *err;
+  valjob *v = val_new((const unsigned char *)doc.fdmem, doc.fsize, from, q,
+    len, &err, value_done);
+
+  if (v != NULL) search_start(&v->j, typed);
+  return err;
+}
+
+/* the next value after the cursor in any encoding, empty repeats */
+static void start_value(void)
+{
+  const char *err;
+
+  if (numlen > 0) {
+    memcpy(numlast, numbuf, numlen);
+    numlastlen = numlen;
+    if (incjob != NULL || incdone) return; // searched as it was typed
+  }
+  if (doc.fdmem == NULL || doc.pc != NULL) {
+    snprintf(message, sizeof(message), "nothing to search");
+    return;
+  }
+  if (numlastlen == 0) return;
+  init_holes();
+  if ((err = value_from(numlast, numlastlen, doc.fpos + win.curpos + 1, 0)))
+    snprintf(message, sizeof(message), "value: %s", err);
+}
+
+static void va_go(void)
+{
+  unsigned long addr = 0;
+  long off;
+
+  for (int i = 0; i < valen; i++)
+    addr = addr << 4 | isasciihex(vabuf[i]);
+  if (valen == 0) return;
+  if ((off = va_to_off(addr)) == -1)
+    snprintf(message, sizeof(message), "%lX not in the file", addr);
+  else
+    go(off);
+}
+
+static void note_commit(void) /* empty removes the note under the cursor */
+{
+  long pos = doc.fpos + win.curpos,
+       start = (anchor != -1 && anchor < pos ? anchor : pos),
+       end   = (anchor != -1 && anchor > pos ? anchor : pos) + 1;
+  span *s;
+
+  if (doc.fdmem == NULL || doc.pc != NULL) return; // notes are of a file
+  notebuf[notelen] = '\0';
+  if (notelen == 0) {
+    if ((s = notes_at(pos)) == NULL) return;
+    notes_remove(s->data);
+  } else if (notes_add(start, end, notebuf) == -1) {
+    snprintf(message, sizeof(message), "note: %s", strerror(errno));
+    return;
+  }
+  anchor = -1;
+  if (notes_save() == -1)
+    snprintf(message, sizeof(message), "notes: %s", strerror(errno));
+}
+
+static void note_jump(int dir)
+{
+  span *s = (doc.fdmem != NULL ?
+    hl_next(HL_NOTE, doc.fpos + win.curpos, dir) : NULL);
+
+  if (s != NULL && doc.pc == NULL)
+    go(s->start);
+  else
+    snprintf(message, sizeof(message), "no more notes");
 }
 
 static void mouse_set_cursor(int x, int y)
@@ -215,11 +963,20 @@ static void grab_input(char c)
         input[1] = c;
       } else {
         input[0] = c;
-        *(doc.fdmem + (doc.fpos + win.curpos)) =
-          (unsigned char)input_to_long(input);
+        edit_byte(&doc.ed, doc.fpos + win.curpos, input_to_long(input));
         clean = 1;
       }
     }
+    else if (currcmd == CMD_FIND) {
+      if (findlen < sizeof(findbuf)) {
+        findbuf[findlen++] = c;
+        inc_search();
+      }
+    }
+    else if (currcmd == CMD_VGO) {
+      if (valen < sizeof(vabuf))
+        vabuf[valen++] = c;
+    }
     else if (currcmd == CMD_GO) {
       int i = 3;
       for (; i >= 0; i--) {
@@ -248,8 +1005,10 @@ static void draw_bitmap(char *s, int x, int y, unsigned int f)
   for (int i = 0; i<sizeof(s); i++, y++) {
     char c = s[i];
     for (int j = 0; j<8; j++) {
-      if ((c>>j)&1)
+      if ((c>>j)&1) {
         SDL_RenderDrawPoint(renderer, x + j, y);
+        prof.draws++;
+      }
     }
   }
 }
@@ -260,25 +1019,42 @@ static void draw_background(void)
   SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, SDL_ALPHA_OPAQUE);
 }
 
-static void draw_text(char *s, int x, int y, unsigned int color)
+static void init_glyphs(void)
 {
-  SDL_Surface *text_surface;
-  SDL_Texture *text_texture;
-  SDL_Rect text_rect;
-  int line_height, line_width;
+  for (int c = 0x20; c < 0x7f; c++) {
+    char s[2] = {c, '\0'};
+    SDL_Surface *sf = TTF_RenderText_Blended(font, s,
+      (SDL_Color){0xff, 0xff, 0xff, 0xff});
+    assert( sf != NULL );
+    glyphs[c].tex = SDL_CreateTextureFromSurface(renderer, sf);
+    glyphs[c].w = sf->w;
+    glyphs[c].h = sf->h;
+    SDL_FreeSurface(sf);
+    assert( glyphs[c].tex != NULL );
+    SDL_SetTextureBlendMode(glyphs[c].tex, SDL_BLENDMODE_BLEND);
+  }
+}
 
-  text_surface = TTF_RenderText_Blended(
-    font, s, TO_SDL_COLOR(color)
-  );
-  TTF_SizeText(font, s,&line_width, &line_height);
-  text_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
-  SDL_FreeSurface(text_surface);
-  text_rect = (SDL_Rect){
-    x, y, line_width, line_height
-  };
+static void draw_glyphs(const char *s, int n, int x, int y, unsigned int color)
+{
+  SDL_Color c = TO_SDL_COLOR(color);
+
+  prof_begin(PROF_GLYPHS);
+  for (int i = 0; i < n; i++) {
+    unsigned char g = s[i];
+    if (g < 0x20 || g > 0x7e) g = '.';
+    SDL_SetTextureColorMod(glyphs[g].tex, c.r, c.g, c.b);
+    SDL_RenderCopy(renderer, glyphs[g].tex, NULL,
+      &(SDL_Rect){ x, y, glyphs[g].w, glyphs[g].h });
+    x += glyphs[g].w;
+    prof.draws++;
+  }
+  prof_end(PROF_GLYPHS);
+}
 
-  SDL_RenderCopy(renderer, text_texture, 0, &text_rect);
-  SDL_DestroyTexture(text_texture);
+static void draw_text(char *s, int x, int y, unsigned int color)
+{
+  draw_glyphs(s, strlen(s), x, y, color);
 }
 
 static void draw_cursor(int x, int y, unsigned int b, unsigned int f, int size)
@@ -290,10 +1066,18 @@ static void draw_cursor(int x, int y, unsigned int b, unsigned int f, int size)
 
   SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, SDL_ALPHA_OPAQUE);
   SDL_RenderFillRect(renderer, &cursor);
+  prof.draws++;
 }
 
 static void draw_infobar(void)
 {
+  span *note;
+  long hole, str;
+  char field[128]; // up to the file size
+  int  room = win.infobar.w / win.font_width - 7;
+
+  if (room > sizeof(field)) room = sizeof(field);
+
   // print cmd
   if (currcmd) {
     switch(currcmd) {
@@ -303,6 +1087,48 @@ static void draw_infobar(void)
       case CMD_INPUT:
         draw_text("&", win.infobar.x, win.infobar.y, theme.ngcolor);
         break;
+      case CMD_FIND: {
+        char pat[sizeof(findbuf)+2] = "/";
+        memcpy(pat + 1, findbuf, findlen);
+        pat[findlen+1] = '\0';
+        draw_text(pat, win.infobar.x, win.infobar.y, theme.ngcolor);
+        break;
+      }
+      case CMD_VGO: {
+        char addr[sizeof(vabuf)+2] = "@";
+        memcpy(addr + 1, vabuf, valen);
+        addr[valen+1] = '\0';
+        draw_text(addr, win.infobar.x, win.infobar.y, theme.ngcolor);
+        break;
+      }
+      case CMD_REGEX: {
+        char text[sizeof(rebuf)+2] = "\\";
+        memcpy(text + 1, rebuf, relen);
+        text[relen+1] = '\0';
+        draw_text(text, win.infobar.x, win.infobar.y, theme.ngcolor);
+        break;
+      }
+      case CMD_VALUE: {
+        char text[sizeof(numbuf)+2] = "=";
+        memcpy(text + 1, numbuf, numlen);
+        text[numlen+1] = '\0';
+        draw_text(text, win.infobar.x, win.infobar.y, theme.ngcolor);
+        break;
+      }
+      case CMD_STRINGS: {
+        char text[sizeof(sfbuf)+2] = "?";
+        memcpy(text + 1, sfbuf, sflen);
+        text[sflen+1] = '\0';
+        draw_text(text, win.infobar.x, win.infobar.y, theme.ngcolor);
+        break;
+      }
+      case CMD_NOTE: {
+        char text[sizeof(notebuf)+2] = "#";
+        memcpy(text + 1, notebuf, notelen);
+        text[notelen+1] = '\0';
+        draw_text(text, win.infobar.x, win.infobar.y, theme.ntcolor);
+        break;
+      }
     }
     for (int i = 0, n = 3; i < 4 ; n--,i++) {
       if (input[i] == 0) continue;
@@ -311,6 +1137,41 @@ static void draw_infobar(void)
       draw_text(c, win.infobar.x + (win.font_width*(n+1)), win.infobar.y,
         theme.ngcolor);
     }
+  } else if (nactive > 0) {
+    char prog[32];
+    snprintf(prog, sizeof(prog), "%s %d%%", active[0]->name,
+      job_progress(active[0]));
+    draw_text(prog, win.infobar.x, win.infobar.y, theme.ngcolor);
+  } else if (*message) {
+    draw_text(message, win.infobar.x, win.infobar.y, theme.ngcolor);
+  } else if (res.on && doc.pc == NULL) {
+    long maj, min;
+    res_faults(&maj, &min);
+    snprintf(field, room, "%ld%% in cache, %ld MiB came in, %ld/%ld faults",
+      res.in * 100 / res.n, res.came * res.psize >> 20, maj - res.majflt,
+      min - res.minflt);
+    draw_text(field, win.infobar.x, win.infobar.y, theme.fgcolor);
+  } else if (doc.pc == NULL &&
+      (note = notes_at(doc.fpos + win.curpos)) != NULL) {
+    snprintf(field, room, "%s", notes.text[note->data]);
+    draw_text(field, win.infobar.x, win.infobar.y, theme.ntcolor);
+  } else if (doc.pc == NULL && overlay &&
+      tmpl_at(doc.fpos + win.curpos, field, room)) {
+    draw_text(field, win.infobar.x, win.infobar.y, theme.fgcolor);
+  } else if (doc.pc == NULL && strings_fresh() &&
+      (str = str_at(doc.fpos + win.curpos)) != -1) {
+    unsigned char t[sizeof(field)];
+    int n = str_text(str, t, sizeof(t));
+    snprintf(field, room, "%s %.*s", str_encs[STR_ENC(strs.h[str])], n, t);
+    draw_text(field, win.infobar.x, win.infobar.y, theme.fgcolor);
+  } else if (doc.pc == NULL && ext_hole(doc.fpos + win.curpos, &hole)) {
+    snprintf(field, room, "hole up to %lX", hole);
+    draw_text(field, win.infobar.x, win.infobar.y, theme.stcolor);
+  } else if (vamode) {
+    int ok;
+    unsigned long addr = va_from_off(doc.fpos + win.curpos, &ok);
+    snprintf(field, room, (ok ? "@%lX" : "@-"), addr);
+    draw_text(field, win.infobar.x, win.infobar.y, theme.mgcolor);
   } else {
     draw_text((doc.magic.suffix != NULL ? doc.magic.suffix : "*")
       , win.infobar.x, win.infobar.y, theme.mgcolor);
@@ -320,8 +1181,8 @@ static void draw_infobar(void)
   // print doc info
   char fsize[5];
   long nsize = doc.fsize;
-  draw_text((doc.ro ? "ro" : "rw"), win.infobar.w-win.font_width,
-    win.infobar.y, theme.ngcolor);
+  draw_text((doc.ro || doc.pc != NULL ? "ro" : "rw"),
+    win.infobar.w-win.font_width, win.infobar.y, theme.ngcolor);
   off_toasciihex(nsize, fsize);
   draw_text(fsize, win.infobar.w - win.font_width*5, win.infobar.y,
     theme.fgcolor);
@@ -339,7 +1200,26 @@ static void draw_infobar(void)
   }
 }
 
-static void draw_offsetcol(void)
+static void draw_hud(void) /* frame timings over the content */
+{
+  char line[32];
+  int x = win.content.x, y = win.content.y;
+
+  for (int i = -1; i <= PROF_PHASES; i++, y += win.font_height) {
+    if (i == -1)
+      snprintf(line, sizeof(line), "frame     %6.2fms", prof.avg_frame);
+    else if (i < PROF_PHASES)
+      snprintf(line, sizeof(line), "%-9s %6.2fms", prof_names[i],
+        prof.avg[i]);
+    else
+      snprintf(line, sizeof(line), "d%-4.0f pf%.0f", prof.avg_draws,
+        prof.avg_faults);
+    draw_cursor(x, y - 1, theme.bgcolor, theme.bgcolor, 18);
+    draw_text(line, x, y, theme.mgcolor);
+  }
+}
+
+static void draw_offsetcol(void) /* low 16 bits, or the address in vamode */
 {
   int posx, posy;
   posy = win.offsetcol.y;
@@ -349,119 +1229,300 @@ static void draw_offsetcol(void)
   long posend = pos + win.colsize * win.rows;
   long cpos = doc.fpos + win.curpos;
   for (int col = 0;pos != posend; col++, pos+=(win.colsize)) {
-    char offstr[5];
+    char offstr[17];
+    int  cur = (cpos-(cpos%win.colsize) == pos), ok = 1;
+    long at = (cur ? cpos : pos);
 
     if (col > 0) posy += win.font_height * 2;
-    if (cpos-(cpos%win.colsize) == pos) {
+    if (vamode) {
+      unsigned long addr = va_from_off(at, &ok);
+      snprintf(offstr, sizeof(offstr), "%0*lX", win.offdigits, addr);
+    } else {
+      off_toasciihex(at, offstr);
+    }
+    if (!ok)
+      memset(offstr, '-', win.offdigits);
+    if (cur) {
       if (doc.magic.suffix != NULL &&
           (doc.magic.hdr_pos-(doc.magic.hdr_pos%win.colsize)) == pos){
-        draw_cursor(posx, posy-1, theme.mgcolor, theme.bgcolor, 4);
+        draw_cursor(posx, posy-1, theme.mgcolor, theme.bgcolor,
+          win.offdigits);
       } else {
-        draw_cursor(posx, posy-1, theme.ngcolor, theme.bgcolor, 4);
+        draw_cursor(posx, posy-1, theme.ngcolor, theme.bgcolor,
+          win.offdigits);
       }
-      off_toasciihex(doc.fpos + win.curpos, offstr);
       draw_text(offstr, posx, posy, theme.bgcolor);
     } else {
-      off_toasciihex(pos, offstr);
       draw_text(offstr, posx, posy, theme.ngcolor);
     }
   }
 }
 
-static void draw_ascii(char s, int x, int row, char cursor, char special)
+/* a row per few pages: came in since shown, mostly resident or cold; the
+   view is a mark over it */
+static void draw_strip(void)
 {
-  int posy = 0;
-  char ascii[2] = {toprintable(s), '\0'};
+  SDL_Rect r = win.strip;
+  SDL_Color c;
+
+  for (int row = 0, end; row < res.rows; row = end) {
+    int k = res_row(row);
+    for (end = row + 1; end < res.rows && res_row(end) == k; end++)
+      ;
+    c = TO_SDL_COLOR(k == RES_CAME ? theme.ngcolor : k == RES_IN ?
+      theme.ntcolor : theme.stcolor);
+    r.y = win.strip.y + (long)row * win.strip.h / res.rows;
+    r.h = win.strip.y + (long)end * win.strip.h / res.rows - r.y;
+    SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, SDL_ALPHA_OPAQUE);
+    SDL_RenderFillRect(renderer, &r);
+    prof.draws++;
+  }
+  c   = TO_SDL_COLOR(theme.fgcolor);
+  r.y = win.strip.y + doc.fpos * win.strip.h / doc.fsize;
+  r.h = win.amount * win.strip.h / doc.fsize;
+  if (r.h < 2) r.h = 2;
+  SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, SDL_ALPHA_OPAQUE);
+  SDL_RenderFillRect(renderer, &r);
+  prof.draws++;
+}
 
-  if (row > 0)
-    posy += (win.font_height * row)*2;
-  if (cursor)
-    draw_cursor(win.asciicol.x + (win.font_width * x), win.asciicol.y + posy-1,
-      (special ? theme.mgcolor:theme.ngcolor), theme.bgcolor, 1);
+/* bytes of the document, straight from the mapping when there's one */
+static const unsigned char *doc_view(long off, long len)
+{
+  if (doc.pc != NULL)
+    return pcache_window(doc.pc, off, len);
+  return (const unsigned char *)doc.fdmem + off;
+}
 
-  unsigned int color = theme.ngcolor;
-  if (cursor) {
-    color = theme.bgcolor;
-  } else if (special) {
-    color = theme.mgcolor;
-  }
-  draw_text(ascii, win.asciicol.x + (win.font_width * x),
-    win.asciicol.y + posy, color);
+static void init_holes(void) /* of a sparse file, dimmed and skipped */
+{
+  const exttab *t;
+  long data = 0;
+
+  if (doc.holes_at == doc.ed.nlog) return; // only edits fill them
+  doc.holes_at = doc.ed.nlog;
+  hl_clear(HL_HOLE);
+  if (ext_open(doc.fd, doc.fsize) > 0)
+    for (long i = 0, n = (t = ext_tab())->n; i <= n; i++) { // the gaps
+      long end = (i < n ? t->e[i].off : doc.fsize);
+      if (end > data) hl_add(data, end, HL_HOLE, theme.stcolor, 0);
+      if (i < n) data = t->e[i].end;
+    }
+  if (nactive == 0) ext_reclaim();
 }
 
 static void init_content(void)
 {
   struct stat st;
 
-  doc.ro = ( access(doc.filepath, W_OK) == -1 );
+  if (doc.ro == -1)
+    doc.ro = ( access(doc.filepath, W_OK) == -1 );
   doc.fd = open(doc.filepath, (!doc.ro ? O_RDWR : O_RDONLY), 0755);
   if (doc.fd == -1) quit(1, "open");
   stat(doc.filepath, &st);
   doc.fsize = st.st_size;
+  if (doc.fsize == 0) { // nothing to map
+    doc.fdmem = NULL;
+    return;
+  }
   doc.fdmem = (char*)mmap(0, doc.fsize,
     (!doc.ro ? PROT_READ|PROT_WRITE : PROT_READ),
     MAP_SHARED|MAP_FILE, doc.fd, 0);
   if (doc.fdmem == MAP_FAILED) quit(1, "mmap");
+  doc.ed = (edit){ .fd = doc.fd, .mem = doc.fdmem, .size = doc.fsize,
+    .logging = !doc.ro };
 
   doc.foff = doc.fpos = 0;
+  doc.holes_at = -1;
   if (doc.fsize > 0)
     doc.magic = find_magic(doc.fdmem, doc.fsize);
+  tmpl_open(doc.fdmem, doc.fsize, doc.magic.suffix, theme.stcolor);
+  va_open(doc.fdmem, doc.fsize);
+  init_holes();
+  if (doc.magic.suffix != NULL) {
+    hl_add(doc.magic.hdr_pos, doc.magic.hdr_pos + doc.magic.hdr_len,
+      HL_MAGIC, theme.mgcolor, 0);
+    if (doc.magic.has_footer)
+      hl_add(doc.fsize - doc.magic.ftr_len, doc.fsize, HL_MAGIC,
+        theme.mgcolor, 0);
+  }
+}
+
+static void init_process(pid_t pid) /* a live process instead of a file */
+{
+  static char name[32];
+  long end;
+
+  snprintf(name, sizeof(name), "pid %d", (int)pid);
+  doc.filepath = name;
+  doc.ro = 1;
+  if ((end = proc_open(pid)) == -1) quit(1, "maps");
+  // a second old at most, what's on screen is read again
+  if (pcache_init(&cache, end, proc_fill, NULL, 1000000000) == -1)
+    quit(1, "pcache");
+  doc.fsize = end;
+  doc.pc = &cache;
+  vamode = 1;
+  win_layout();
+  go(va.byoff[0].off);
+}
+
+static void res_done(job *j) /* what was resident when shown is known */
+{
+  resjob    = NULL;
+  res.ready = 1;
+  res.base  = !job_cancelled(j); // else the first pass is
+  free(j);
+  if (!res.on) res_close(); // hidden before it was done
+}
+
+static void res_toggle(void) /* taken when shown, let go when hidden */
+{
+  if (res.on) {
+    res.on = 0;
+    if (resjob != NULL)
+      job_cancel(resjob); // still writing the pages, closed once done
+    else
+      res_close();
+    return;
+  }
+  if (resjob == NULL) { // else shown again before it was done
+    if ((resjob = res_open(doc.fdmem, doc.fsize, win.strip.h, res_done)) ==
+        NULL) {
+      snprintf(message, sizeof(message), "no mapping");
+      return;
+    }
+    res.on = 1;
+    job_start(resjob);
+    return;
+  }
+  res.on = 1;
+}
+
+static void gz_done(job *j)
+{
+  gzbuild = NULL;
+  if (!job_cancelled(j) && ((gzjob *)j)->n > 0) {
+    gz_take((gzjob *)j);
+    if (pcache_init(&cache, gz.out, gz_fill, NULL, 0) == 0) {
+      gz_view(1);
+      snprintf(message, sizeof(message), "gunzipped, z for the raw bytes");
+    }
+  }
+  free(((gzjob *)j)->p);
+  free(j);
+}
+
+static void gz_start(void) /* the decoded view, the index first */
+{
+  if (gz.n > 0 || gzbuild != NULL) return;
+  if (gz_load() == 0) {
+    if (pcache_init(&cache, gz.out, gz_fill, NULL, 0) == 0)
+      gz_view(1);
+    return;
+  }
+  if ((gzbuild = gz_new(gz_done)) != NULL)
+    job_start(&gzbuild->j);
+}
+
+static void gz_view(int decoded) /* of a gzip file, or its raw bytes */
+{
+  long pos = doc.fpos + win.curpos;
+
+  if (decoded == (doc.pc != NULL)) return;
+  doc.pc    = (decoded ? &cache : NULL);
+  doc.fsize = (decoded ? gz.out : gz.size);
+  go(gzpos);
+  gzpos = pos;
 }
 
 static void show_content(void)
 {
-  char *docptr = (char*)doc.fdmem;
-  long displaypos = doc.fpos;
-  int posx = win.content.x, posy = win.content.y;
+  char hex[win.colsize*2], ascii[win.colsize];
+  hlrun runs[win.colsize];
+  long off = doc.fpos;
+  int posy = win.content.y;
+  const unsigned char *view = doc_view(doc.fpos, win.amount);
 
   SDL_RenderClear(renderer);
-  for (int n = 0, nb = 0, r = 0; n < win.amount; n++) {
-    char hex[3];
-    unsigned char data = docptr[displaypos];
-    if (displaypos < doc.fsize) {
-      char special = 0;
-      toasciihex(data, hex);
-
-      special = (
-        // header
-        ( displaypos >= doc.magic.hdr_pos
-        && displaypos < (doc.magic.hdr_pos+doc.magic.hdr_len) )
-        ||
-        // footer
-        ((doc.fsize - doc.magic.ftr_len) <= displaypos && doc.magic.has_footer)
-      );
-
-      if (n == win.curpos) { // cursor
-        draw_cursor(posx, posy-1, (special ? theme.mgcolor:theme.ngcolor),
-          theme.bgcolor, 2);
-        draw_text(hex, posx, posy, theme.bgcolor);
-      } else {
-        draw_text(hex, posx, posy, (special ? theme.mgcolor:theme.fgcolor));
-      }
-      draw_ascii(data, nb, r, (n == win.curpos), special);
-      nb++; displaypos++;
-    }
-    posx += win.font_width * 2;
-    if (n > 0) {
-      if (nb % win.colsize == 0 || displaypos == doc.fsize) { // eol
-        posy += win.font_height * 2;
-        posx = win.content.x;
-        nb = 0;
-        r++;
-        if (displaypos == doc.fsize) { displaypos++; nb++; }
-      } else {
-        if (nb%4 == 0) { // space
-          draw_text(" ", posx, posy, theme.fgcolor);
-          posx += win.font_width;
+  prof_begin(PROF_CONTENT);
+  hl_window(doc.fpos, win.amount);
+  if (doc.pc != NULL) // spans are about the mapped bytes
+    hl.nvis = 0;
+  else if (overlay)
+    hl.nvis += tmpl_window(doc.fpos, win.amount, hl.vis + hl.nvis,
+      HL_VISMAX - hl.nvis);
+  for (int r = 0; view != NULL && r < win.rows && off < doc.fsize; r++) {
+    int n = (doc.fsize - off < win.colsize ? doc.fsize - off : win.colsize);
+    int nruns = hl_row(off, n, runs), run = 0;
+    int posx = win.content.x,
+        asciix = win.asciicol.x,
+        asciiy = win.asciicol.y + posy - win.content.y;
+
+    fmt_row(view + (off - doc.fpos), n, hex, ascii);
+    if (doc.pc != NULL) // what couldn't be read
+      for (int i = 0; i < n; i++)
+        if (doc.pc->bad[off - doc.fpos + i]) {
+          hex[i*2] = hex[i*2+1] = '?';
+          ascii[i] = ' ';
         }
+    for (int i = 0; i < n; i++, posx += win.font_width*2,
+        asciix += win.font_width) {
+      hlrun *h;
+      if (i > 0 && i%4 == 0) posx += win.font_width; // space
+      while (run < nruns && runs[run].to <= i) run++;
+      h = (run < nruns && runs[run].from <= i ? &runs[run] : NULL);
+      if (off + i == doc.fpos + win.curpos) { // cursor
+        unsigned int bg = (h != NULL ? h->color : theme.ngcolor);
+        draw_cursor(posx, posy-1, bg, theme.bgcolor, 2);
+        draw_glyphs(hex + i*2, 2, posx, posy, theme.bgcolor);
+        draw_cursor(asciix, asciiy-1, bg, theme.bgcolor, 1);
+        draw_glyphs(ascii + i, 1, asciix, asciiy, theme.bgcolor);
+      } else {
+        draw_glyphs(hex + i*2, 2, posx, posy,
+          (h != NULL ? h->color : theme.fgcolor));
+        draw_glyphs(ascii + i, 1, asciix, asciiy,
+          (h != NULL ? h->color : theme.ngcolor));
       }
     }
+    off  += win.colsize;
+    posy += win.font_height * 2;
   }
 
+  prof_end(PROF_CONTENT);
+
+  prof_begin(PROF_OFFSETCOL);
   draw_offsetcol();
+  prof_end(PROF_OFFSETCOL);
+  prof_begin(PROF_INFOBAR);
   draw_infobar();
+  if (res.on && doc.pc == NULL) draw_strip();
+  prof_end(PROF_INFOBAR);
+  if (prof.hud) {
+    prof_begin(PROF_HUD);
+    draw_hud();
+    prof_end(PROF_HUD);
+  }
   draw_background();
+  prof_begin(PROF_PRESENT);
   SDL_RenderPresent(renderer);
+  prof_end(PROF_PRESENT);
+}
+
+/* the text of a command that takes some, NULL for the others */
+static char *cmd_text(int **len, int *size)
+{
+  switch (currcmd) {
+    case CMD_NOTE:
+      *len = &notelen; *size = sizeof(notebuf); return notebuf;
+    case CMD_STRINGS:
+      *len = &sflen; *size = sizeof(sfbuf); return sfbuf;
+    case CMD_REGEX:
+      *len = &relen; *size = sizeof(rebuf); return rebuf;
+    case CMD_VALUE:
+      *len = &numlen; *size = sizeof(numbuf); return numbuf;
+  }
+  return NULL;
 }
 
 static void drag_window(void)
@@ -471,171 +1532,340 @@ static void drag_window(void)
   SDL_SetWindowPosition(window, (mousex - drag_mx), (mousey - drag_my));
 }
 
-static void running(void)
+static int shifted(SDL_Keymod mod) /* the upper case binding of a key */
 {
-  SDL_Event e;
+  return (mod == KMOD_LSHIFT || mod == KMOD_RSHIFT || mod == KMOD_CAPS);
+}
 
-  while (1){
-    show_content();
-    while (SDL_PollEvent(&e)){
-      if (e.type == SDL_QUIT){
-        quit(0, NULL);
-      }
-      SDL_Keymod mod = SDL_GetModState();
-
-      // drag window
-      if (e.type == SDL_MOUSEBUTTONUP || e.type == SDL_MOUSEBUTTONDOWN) {
-        if (e.button.state == SDL_PRESSED) {
-          drag_mx  = e.button.x;
-          drag_my  = e.button.y;
-          dragging = 1;
-        } else {
-          if (dragging)
-            mouse_set_cursor(e.button.x, e.button.y);
-          dragging = 0;
-        }
+static void handle_event(SDL_Event *e)
+{
+  char *text;
+  int  *len, size;
+
+  if (e->type == SDL_QUIT){
+    quit(0, NULL);
+  }
+  if (e->type == jobevent) {
+    job_finish(e->user.data1);
+    return;
+  }
+  if (e->type == SDL_TEXTINPUT && currcmd == CMD_NONE &&
+      strcmp(e->text.text, "?") == 0) { // filters the strings
+    currcmd = CMD_STRINGS;
+    sflen = 0;
+    return;
+  }
+  if (e->type == SDL_TEXTINPUT && (text = cmd_text(&len, &size)) != NULL) {
+    int n = strlen(e->text.text);
+    if (*len + n < size) {
+      memcpy(text + *len, e->text.text, n);
+      *len += n;
+      if (currcmd == CMD_REGEX || currcmd == CMD_VALUE) inc_search();
+    }
+    return;
+  }
+  SDL_Keymod mod = e->key.keysym.mod; // as it was, also when replayed
+
+  // drag window
+  if (e->type == SDL_MOUSEBUTTONUP || e->type == SDL_MOUSEBUTTONDOWN) {
+    if (e->button.state == SDL_PRESSED) {
+      drag_mx  = e->button.x;
+      drag_my  = e->button.y;
+      dragging = 1;
+    } else {
+      if (dragging)
+        mouse_set_cursor(e->button.x, e->button.y);
+      dragging = 0;
+    }
+  }
+  if (e->type == SDL_MOUSEMOTION && dragging)
+    drag_window();
+
+  SDL_Keysym ksym = e->key.keysym;
+  // key navigation
+  if (e->type == SDL_KEYDOWN) {
+    int newcurpos = win.curpos;
+    long hole;
+    *message = '\0';
+
+    if (!doc.ro && doc.pc == NULL && cmd_text(&len, &size) == NULL) {
+      long pos = doc.fpos + win.curpos;
+      if (ksym.sym == SDLK_EQUALS) {
+        edit_add(&doc.ed, pos, 1);
+      } else if (ksym.sym == SDLK_MINUS) {
+        edit_add(&doc.ed, pos, -1);
       }
-      if (e.type == SDL_MOUSEMOTION && dragging)
-        drag_window();
-
-      SDL_Keysym ksym = e.key.keysym;
-      // key navigation
-      if (e.type == SDL_KEYDOWN) {
-        int newcurpos = win.curpos;
-
-        if (!doc.ro) {
-          unsigned char *pos = (unsigned char *)(
-            doc.fdmem + (doc.fpos + win.curpos)
-          );
-          if (ksym.sym == SDLK_EQUALS || ksym.sym == SDLK_MINUS) {
-            unsigned char value = *pos;
-            if (ksym.sym == SDLK_EQUALS) {
-              value++;
-            } else if (ksym.sym == SDLK_MINUS) {
-              value--;
-            }
-            *pos = value;
-          }
 
-          if (ksym.sym == SDLK_n) { // NOP
-            if (*pos != 0x90)
-              *pos = 0x90;
-          }
-        }
+      if (ksym.sym == SDLK_n) // NOP
+        edit_nop(&doc.ed, pos);
+    }
 
-        if (ksym.sym == SDLK_LEFT) {
-          if (newcurpos == 0 && doc.fpos - (win.amount-1) >= 0) {
-            newcurpos = win.amount - 1;
-            doc.fpos -= win.amount;
-          } else {
-            if (doc.fpos != 0 || newcurpos != 0)
-              newcurpos--;
-          }
-        }
-        if (ksym.sym == SDLK_RIGHT) {
-          if (newcurpos + 1> win.amount - 1) {
-            if (doc.fpos + win.amount < doc.fsize) {
-              newcurpos = 0;
-              doc.fpos += win.amount;
-            }
-          } else if ((doc.fpos + newcurpos + 1) < doc.fsize) {
-            newcurpos++;
-          }
-        }
-        if (ksym.sym == SDLK_DOWN || ksym.sym == SDLK_PAGEDOWN) {
-          if (
-              (win.curpos + win.colsize) < win.amount &&
-              (win.curpos + win.colsize + doc.fpos) < doc.fsize &&
-              ksym.sym == SDLK_DOWN) {
-            newcurpos += win.colsize;
-          } else {
-            if (doc.fpos + win.amount < doc.fsize) {
-              if (ksym.sym == SDLK_DOWN)
-                newcurpos = win.colsize - (win.amount - newcurpos) ;
-              doc.fpos += win.amount;
-
-              if ((newcurpos + doc.fpos) > doc.fsize) { // avoid overflow
-                newcurpos = doc.fsize - doc.fpos - 1;
-              }
-            }
-          }
+    if (ksym.sym == SDLK_LEFT) {
+      if (newcurpos == 0 && doc.fpos - (win.amount-1) >= 0) {
+        newcurpos = win.amount - 1;
+        doc.fpos -= win.amount;
+      } else {
+        if (doc.fpos != 0 || newcurpos != 0)
+          newcurpos--;
+      }
+    }
+    if (ksym.sym == SDLK_RIGHT) {
+      if (newcurpos + 1> win.amount - 1) {
+        if (doc.fpos + win.amount < doc.fsize) {
+          newcurpos = 0;
+          doc.fpos += win.amount;
         }
-        if (ksym.sym == SDLK_UP || ksym.sym == SDLK_PAGEUP) {
-          if ((win.curpos - win.colsize) > -1 && ksym.sym == SDLK_UP) {
-            newcurpos -= win.colsize;
-          } else {
-            if (doc.fpos-win.amount >= 0) {
-              if (ksym.sym == SDLK_UP)
-                newcurpos = win.amount - (win.colsize - newcurpos);
-              doc.fpos -= win.amount;
-            }
+      } else if ((doc.fpos + newcurpos + 1) < doc.fsize) {
+        newcurpos++;
+      }
+    }
+    if (ksym.sym == SDLK_DOWN || ksym.sym == SDLK_PAGEDOWN) {
+      if (
+          (win.curpos + win.colsize) < win.amount &&
+          (win.curpos + win.colsize + doc.fpos) < doc.fsize &&
+          ksym.sym == SDLK_DOWN) {
+        newcurpos += win.colsize;
+      } else {
+        if (doc.fpos + win.amount < doc.fsize) {
+          if (ksym.sym == SDLK_DOWN)
+            newcurpos = win.colsize - (win.amount - newcurpos) ;
+          doc.fpos += win.amount;
+
+          if ((newcurpos + doc.fpos) > doc.fsize) { // avoid overflow
+            newcurpos = doc.fsize - doc.fpos - 1;
           }
         }
-        if (ksym.sym == SDLK_HOME) {
-          doc.fpos  = 0;
-          newcurpos = 0;
-        }
-        if (ksym.sym == SDLK_END) {
-          doc.fpos  = doc.fsize - (doc.fsize%win.amount);
-          newcurpos = doc.fsize - doc.fpos - 1;
+      }
+    }
+    if (ksym.sym == SDLK_UP || ksym.sym == SDLK_PAGEUP) {
+      if ((win.curpos - win.colsize) > -1 && ksym.sym == SDLK_UP) {
+        newcurpos -= win.colsize;
+      } else {
+        if (doc.fpos-win.amount >= 0) {
+          if (ksym.sym == SDLK_UP)
+            newcurpos = win.amount - (win.colsize - newcurpos);
+          doc.fpos -= win.amount;
         }
-        win.curpos = newcurpos;
       }
+    }
+    if (ksym.sym == SDLK_HOME) {
+      doc.fpos  = 0;
+      newcurpos = 0;
+    }
+    if (ksym.sym == SDLK_END) {
+      doc.fpos  = doc.fsize - (doc.fsize%win.amount);
+      newcurpos = doc.fsize - doc.fpos - 1;
+    }
+    win.curpos = newcurpos;
+
+    // paging by address skips what isn't mapped
+    if (vamode && (ksym.sym == SDLK_PAGEDOWN || ksym.sym == SDLK_PAGEUP ||
+        ksym.sym == SDLK_DOWN || ksym.sym == SDLK_UP) &&
+        !va_mapped(doc.fpos, win.amount)) {
+      long next = va_skip(doc.fpos, (ksym.sym == SDLK_PAGEDOWN ||
+        ksym.sym == SDLK_DOWN ? 1 : -1));
+      if (next != -1) go(next);
+    }
+    // holes are collapsed the same way
+    if (!vamode && doc.pc == NULL && (ksym.sym == SDLK_PAGEDOWN ||
+        ksym.sym == SDLK_PAGEUP || ksym.sym == SDLK_DOWN ||
+        ksym.sym == SDLK_UP) && ext_data(doc.fpos, doc.fpos + win.amount,
+        &hole) == -1) {
+      long next = ext_skip(doc.fpos, (ksym.sym == SDLK_PAGEDOWN ||
+        ksym.sym == SDLK_DOWN ? 1 : -1));
+      if (next != -1) go(next);
+    }
+  }
 
-      // key commands
-      if (e.type == SDL_KEYUP) {
+  // key commands
+  if (e->type == SDL_KEYUP && cmd_text(&len, &size) != NULL) { // typing
+    switch (ksym.sym) {
+      case SDLK_RETURN: case SDLK_RETURN2:
+        if (currcmd == CMD_NOTE) note_commit();
+        if (currcmd == CMD_STRINGS) start_strfind();
+        if (currcmd == CMD_REGEX) start_regex();
+        if (currcmd == CMD_VALUE) start_value();
+        currcmd = CMD_NONE;
+        break;
+      case SDLK_ESCAPE:
+        if (currcmd == CMD_REGEX || currcmd == CMD_VALUE) inc_cancel();
+        currcmd = CMD_NONE;
+        break;
+      case SDLK_BACKSPACE:
+        if (*len > 0) {
+          (*len)--;
+          if (currcmd == CMD_REGEX || currcmd == CMD_VALUE) inc_search();
+        }
+        break;
+    }
+    return;
+  }
+  if (e->type == SDL_KEYUP) {
 //         if (ksym.mod != KMOD_NONE)
 //           break;
 
-        switch(ksym.sym){
-          case SDLK_0: case SDLK_1: case SDLK_2: case SDLK_3: case SDLK_4:
-          case SDLK_5: case SDLK_6: case SDLK_7: case SDLK_8: case SDLK_9:
-          case SDLK_a: case SDLK_b: case SDLK_c: case SDLK_d: case SDLK_e:
-          case SDLK_f:
-              if (!doc.ro && !currcmd)
-                currcmd = CMD_INPUT;
-              grab_input(ksym.sym);
-            break;
-          case SDLK_g: currcmd = CMD_GO; break;
-          case SDLK_x:
-            // if 'x' copy 1 byte and 'X' four bytes
-            copy_bytes((mod == KMOD_LSHIFT || mod == KMOD_RSHIFT  ||
-              mod == KMOD_CAPS)?4:1);
-            break;
-          case SDLK_ESCAPE:
-          case SDLK_q: quit(0, NULL); break;
-          case SDLK_RETURN: case SDLK_RETURN2:
-            if (currcmd == CMD_GO) go(input_to_long(input));
-          default: memset(&input, 0, 4); currcmd = CMD_NONE;
+    switch(ksym.sym){
+      case SDLK_0: case SDLK_1: case SDLK_2: case SDLK_3: case SDLK_4:
+      case SDLK_5: case SDLK_6: case SDLK_7: case SDLK_8: case SDLK_9:
+      case SDLK_a: case SDLK_b: case SDLK_c: case SDLK_d: case SDLK_e:
+      case SDLK_f:
+          if (!doc.ro && doc.pc == NULL && !currcmd)
+            currcmd = CMD_INPUT;
+          grab_input(ksym.sym);
+        break;
+      case SDLK_g:
+        currcmd = (vamode ? CMD_VGO : CMD_GO);
+        valen = 0;
+        break;
+      case SDLK_v:
+        if (va.n > 0) {
+          vamode = !vamode;
+          win_layout();
+        } else
+          snprintf(message, sizeof(message), "no segments");
+        break;
+      case SDLK_SLASH:
+        currcmd = CMD_FIND;
+        findlen = 0;
+        incfrom = doc.fpos + win.curpos;
+        incdone = 0;
+        init_holes(); // edits may have filled some
+        break;
+      case SDLK_BACKSLASH:
+        currcmd = CMD_REGEX;
+        relen   = 0;
+        incfrom = doc.fpos + win.curpos;
+        incdone = 0;
+        init_holes();
+        break;
+      case SDLK_k:
+        currcmd = CMD_VALUE;
+        numlen  = 0;
+        incfrom = doc.fpos + win.curpos;
+        incdone = 0;
+        init_holes();
+        break;
+      case SDLK_BACKSPACE: // of the pattern being typed
+        if (currcmd == CMD_FIND && findlen > 0) {
+          findlen--;
+          inc_search();
+          break;
         }
-      }
+        memset(&input, 0, 4);
+        currcmd = CMD_NONE;
+        break;
+      case SDLK_l: strings_jump(shifted(mod) ? -1 : 1); break;
+      case SDLK_i: start_index(); break;
+      case SDLK_p: if (!doc.ro) export_patch(); break;
+      case SDLK_w: extract_range(); break;
+      case SDLK_s: if (!doc.ro && doc.pc == NULL) sums_start(1); break;
+      case SDLK_m:
+        if (doc.fdmem == NULL) { // a process, or an empty file
+          snprintf(message, sizeof(message), "nothing to note");
+        } else if (doc.pc != NULL) {
+          snprintf(message, sizeof(message), "notes are for the raw bytes");
+        } else if (shifted(mod)) {
+          anchor = doc.fpos + win.curpos;
+          snprintf(message, sizeof(message), "note from %lX", anchor);
+        } else {
+          currcmd = CMD_NOTE;
+          notelen = 0;
+        }
+        break;
+      case SDLK_t: overlay = !overlay; break;
+      case SDLK_j: // next data extent, J the one before
+        if (!ext_tab()->sparse || doc.pc != NULL) {
+          snprintf(message, sizeof(message), "no holes");
+        } else {
+          long next = ext_next(doc.fpos + win.curpos, shifted(mod) ? -1 : 1);
+          if (next != -1) go(next);
+        }
+        break;
+      case SDLK_r: if (doc.pc != NULL) pcache_drop(doc.pc); break;
+      case SDLK_z:
+        if (gz.n > 0)
+          gz_view(doc.pc == NULL);
+        else if (gz.mem != NULL)
+          gz_start();
+        break;
+      case SDLK_RIGHTBRACKET: note_jump(1); break;
+      case SDLK_LEFTBRACKET: note_jump(-1); break;
+      case SDLK_F1: prof.hud = !prof.hud; break;
+      case SDLK_F2: // page cache residency
+        if (doc.fdmem == NULL || doc.pc != NULL)
+          snprintf(message, sizeof(message), "no mapping");
+        else
+          res_toggle();
+        break;
+      case SDLK_x:
+        // if 'x' copy 1 byte and 'X' four bytes
+        copy_bytes(shifted(mod) ? 4 : 1);
+        break;
+      case SDLK_ESCAPE: // cancels the running jobs first
+        if (currcmd == CMD_FIND) {
+          inc_cancel();
+          currcmd = CMD_NONE;
+          break;
+        }
+        if (nactive > 0) {
+          for (int i = 0; i < nactive; i++)
+            job_cancel(active[i]);
+          break;
+        }
+      case SDLK_q: quit(0, NULL); break;
+      case SDLK_RETURN: case SDLK_RETURN2:
+        if (currcmd == CMD_GO) go(input_to_long(input));
+        if (currcmd == CMD_FIND) start_find();
+        if (currcmd == CMD_VGO) va_go();
+      default: memset(&input, 0, 4); currcmd = CMD_NONE;
     }
   }
 }
 
-int main(int argc, char **argv)
+static void running(void)
 {
-  SDL_RWops *RWfont;
-
-  argc--; argv++;
-  if (argc == 0)
-    exit(1);
-  doc.filepath = *argv;
+  SDL_Event e;
 
-  assert( SDL_Init(SDL_INIT_VIDEO) == 0 );
-  SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
+  while (1){
+    prof_frame_begin();
+    show_content();
+    replay_presented(prof_now());
+    if (replay.done) {
+      replay_report(stderr);
+      quit(0, NULL);
+    }
 
-  if (TTF_Init() < 0 ) quit(1, NULL);
-  assert( (RWfont = SDL_RWFromConstMem(ttf, ttf_len)) != NULL );
-  font = TTF_OpenFontRW(RWfont, 1, theme.font_size);
-  assert( font != NULL );
-  get_font_width();
+    prof_begin(PROF_EVENTS);
+    while (SDL_PollEvent(&e)) {
+      if (replay_isinput(&e)) {
+        if (replay.play != NULL) continue; // only the recorded input
+        if (replay.rec != NULL) replay_record(&e);
+        // when it arrived, not when it got polled
+        replay_mark(prof_now() -
+          (uint64_t)(SDL_GetTicks() - e.common.timestamp) * 1000000);
+      }
+      handle_event(&e);
+    }
+    while (replay.play != NULL && replay_next(&e)) {
+      replay_mark(prof_now());
+      handle_event(&e);
+    }
+    inc_show();
+    res_tick(prof_now());
+    tmpl_tick();
+    prof_end(PROF_EVENTS);
+    prof_frame_end();
+    replay.frame++;
+  }
+}
 
-  win.colsize = 4*win.cols;
-  win.amount  = win.colsize*win.rows;
+static void win_layout(void) /* the offset column as wide as its offsets */
+{
+  win.offdigits = (vamode ? va_digits() : 4);
   win.height  = win.font_height * 3 + ((win.font_height*2)*win.rows) + 2 ;
   win.offsetcol = (SDL_Rect){
-    win.font_width, win.font_height, win.font_width * 6, win.height
+    win.font_width, win.font_height, win.font_width * (win.offdigits + 2),
+    win.height
   };
   win.content = (SDL_Rect){
     win.offsetcol.w, win.font_height,
@@ -649,10 +1879,35 @@ int main(int argc, char **argv)
     win.height
   };
   win.width   = win.offsetcol.w + win.content.w + win.asciicol.w;
+  win.strip   = (SDL_Rect){ // in the space after the ascii column
+    win.width - win.font_width + 1, win.content.y, win.font_width / 2,
+    win.font_height * 2 * win.rows - win.font_height
+  };
   win.infobar = (SDL_Rect){
     win.font_width, win.content.h - win.font_height,
     win.width - win.font_width*2, win.font_height
   };
+  if (window != NULL)
+    SDL_SetWindowSize(window, win.width, win.height);
+}
+
+static void init_window(void) /* SDL, font and the layout of the window */
+{
+  SDL_RWops *RWfont;
+
+  assert( SDL_Init(SDL_INIT_VIDEO) == 0 );
+  SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
+  jobevent = SDL_RegisterEvents(1);
+  assert( jobs_init(pool_threads() > 1 ? pool_threads() - 1 : 1,
+    job_notify) == 0 );
+
+  if (TTF_Init() < 0 ) quit(1, NULL);
+  assert( (RWfont = SDL_RWFromConstMem(ttf, ttf_len)) != NULL );
+  font = TTF_OpenFontRW(RWfont, 1, theme.font_size);
+  assert( font != NULL );
+  get_font_width();
+
+  win_layout();
   window = SDL_CreateWindow(
     "hexing",
     SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -669,12 +1924,218 @@ int main(int argc, char **argv)
     renderer = SDL_CreateRenderer(window, -1,
       SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
   assert(renderer != NULL);
+  init_glyphs();
+}
+
+#ifndef HEXING_NO_MAIN // the benchmarks bring their own
+static void usage(void)
+{
+  fprintf(stderr,
+    "usage: hexing [options] file\n"
+    "  --dump     write the hex view of the file to stdout and exit\n"
+    "  --undump   read a dump or plain hex from stdin into the file\n"
+    "  --patch script file...\n"
+    "             apply a patch script to every file and report\n"
+    "  -n         with --patch, only check what would be patched\n"
+    "  --apply patch.ups file\n"
+    "             apply an UPS patch checking both checksums first\n"
+    "  --extract out file\n"
+    "             copy the range of -s and -l to a new file\n"
+    "  --strings  print the strings of the file with their offsets\n"
+    "  --index    build the search index of a read only file\n"
+    "  -s offset  start of the dumped or extracted range\n"
+    "  -l length  length of the dumped or extracted range\n"
+    "  -c cols    groups of 4 bytes per row\n"
+    "  --trace file.json\n"
+    "             write frame timings as chrome trace events\n"
+    "  --record file\n"
+    "             save the input of the session to replay it later\n"
+    "  --replay file\n"
+    "             replay recorded input frame by frame, report latencies\n"
+    "  --pid N    browse the memory of a running process\n"
+    "  --notes file\n"
+    "             import `start end text` lines (hex) as notes\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  int  mode = MODE_GUI, dry = 0;
+  long range_start = 0, range_len = -1;
+  char *script = NULL, *import = NULL;
+  pid_t pid = 0;
+
+  argc--; argv++;
+  for (; argc > 0 && **argv == '-'; argc--, argv++) {
+    if (strcmp(*argv, "--dump") == 0) {
+      mode = MODE_DUMP;
+    } else if (strcmp(*argv, "--undump") == 0) {
+      mode = MODE_UNDUMP;
+    } else if (strcmp(*argv, "--strings") == 0) {
+      mode = MODE_STRINGS;
+    } else if (strcmp(*argv, "--index") == 0) {
+      mode = MODE_INDEX;
+    } else if (argc > 1 && strcmp(*argv, "--patch") == 0) {
+      mode = MODE_PATCH;
+      script = *++argv; argc--;
+    } else if (argc > 1 && strcmp(*argv, "--apply") == 0) {
+      mode = MODE_APPLY;
+      script = *++argv; argc--;
+    } else if (argc > 1 && strcmp(*argv, "--extract") == 0) {
+      mode = MODE_EXTRACT;
+      script = *++argv; argc--;
+    } else if (argc > 1 && strcmp(*argv, "--trace") == 0) {
+      if (prof_trace_open(*++argv) == -1) quit(1, *argv);
+      argc--;
+    } else if (argc > 1 && strcmp(*argv, "--record") == 0) {
+      if ((replay.rec = fopen(*++argv, "w")) == NULL) quit(1, *argv);
+      argc--;
+    } else if (argc > 1 && strcmp(*argv, "--replay") == 0) {
+      if ((replay.play = fopen(*++argv, "r")) == NULL) quit(1, *argv);
+      argc--;
+    } else if (argc > 1 && strcmp(*argv, "--pid") == 0) {
+      pid = atoi(*++argv); argc--;
+      if (pid <= 0) usage();
+    } else if (argc > 1 && strcmp(*argv, "--notes") == 0) {
+      import = *++argv; argc--;
+    } else if (strcmp(*argv, "-n") == 0) {
+      dry = 1;
+    } else if (argc > 1 && strcmp(*argv, "-s") == 0) {
+      range_start = strtol(*++argv, NULL, 0); argc--;
+    } else if (argc > 1 && strcmp(*argv, "-l") == 0) {
+      range_len = strtol(*++argv, NULL, 0); argc--;
+    } else if (argc > 1 && strcmp(*argv, "-c") == 0) {
+      win.cols = atoi(*++argv); argc--;
+      if (win.cols < 1) usage();
+    } else {
+      usage();
+    }
+  }
+  if ((argc == 0) != (pid > 0) || (pid > 0 && mode != MODE_GUI))
+    usage();
+  if (mode == MODE_PATCH) { // headless, many files
+    patchjob job = { .dry = dry, .files = argv };
+    FILE *f = fopen(script, "r");
+    int line;
+    if (f == NULL) quit(1, script);
+    job.nent = patch_parse(f, &job.ent, &line);
+    fclose(f);
+    if (job.nent == -1) {
+      fprintf(stderr, "%s: bad patch at line %d\n", script, line);
+      exit(1);
+    }
+    if ((job.rep = calloc(argc, sizeof(patchreport))) == NULL)
+      quit(1, "calloc");
+    pool_run(argc, pool_threads(), patch_worker, &job);
+    exit(patch_report(stdout, &job, argc) > 0);
+  }
+  doc.filepath = *argv;
+  if (mode == MODE_APPLY) {
+    int r;
+    if ((doc.fd = open(doc.filepath, O_RDWR)) == -1) quit(1, "open");
+    if ((r = ups_apply(doc.fd, script)) != UPS_OK) {
+      fprintf(stderr, "%s: %s\n", script, ups_errors[r]);
+      exit(r != UPS_ALREADY);
+    }
+    exit(0);
+  }
+  if (mode == MODE_EXTRACT) { // the kernel copies, see extract.h
+    struct stat st;
+    if ((doc.fd = open(doc.filepath, O_RDONLY)) == -1 ||
+        fstat(doc.fd, &st) == -1)
+      quit(1, "open");
+    if (range_len == -1) range_len = st.st_size - range_start;
+    if (extract(doc.fd, range_start, range_len, script) == -1)
+      quit(1, script);
+    exit(0);
+  }
+  win.colsize = 4*win.cols;
+  win.amount  = win.colsize*win.rows;
+
+  if (mode == MODE_DUMP) { // headless, no SDL
+    doc.ro = 1;
+    init_content();
+    if (doc.fsize > 0)
+      madvise(doc.fdmem, doc.fsize, MADV_SEQUENTIAL);
+    if (dump(STDOUT_FILENO, (unsigned char *)doc.fdmem, doc.fsize,
+        range_start, range_len, win.colsize) == -1)
+      quit(1, "dump");
+    quit(0, NULL);
+  }
+  if (mode == MODE_STRINGS) { // headless, the same scan on a pool
+    strjob *s;
+    unsigned char t[0x10000];
+    doc.ro = 1;
+    init_content();
+    if ((s = str_new(doc.fdmem, doc.fsize, NULL)) == NULL) quit(0, NULL);
+    pool_run(s->j.nchunks, pool_threads(), str_worker, s);
+    if (str_take(s) == -1) quit(1, "strings");
+    str_free(s);
+    for (long i = 0; i < strs.n; i++)
+      printf("%8lx %-8s %.*s\n", STR_OFF(strs.h[i]),
+        str_encs[STR_ENC(strs.h[i])], (int)str_text(i, t, sizeof(t)), t);
+    quit(0, NULL);
+  }
+  if (mode == MODE_INDEX) { // headless, the same job on a pool
+    ngjob *g;
+    doc.ro = 1;
+    init_content();
+    if (doc.fsize == 0 || ng_open(doc.filepath, doc.fd) == 0)
+      quit(0, NULL); // nothing to do
+    if ((g = ng_new(doc.fdmem, doc.fsize, NULL)) == NULL) quit(1, "index");
+    pool_run(g->j.nchunks, pool_threads(), ng_worker, g);
+    if (ng_finish(g) == -1) quit(1, "index");
+    ng_free(g);
+    fprintf(stderr, "index of %ld KiB, %d%% always read\n", ngi.len >> 10,
+      (int)(ng_full() * NG_BLOCK * 100 / doc.fsize));
+    quit(0, NULL);
+  }
+  if (mode == MODE_UNDUMP) { // existing files only get the changed ranges
+    long line, n;
+    int patch = ( access(doc.filepath, F_OK) == 0 );
+    if ((doc.fd = open(doc.filepath, O_RDWR|O_CREAT, 0644)) == -1)
+      quit(1, "open");
+    if ((n = undump(STDIN_FILENO, doc.fd, patch, &line)) == -1) {
+      fprintf(stderr, "undump: line %ld\n", line);
+      quit(1, "undump");
+    }
+    fprintf(stderr, "%ld bytes written\n", n);
+    quit(0, NULL);
+  }
+
+  init_window();
 
   spaces  = win.cols - 1;
   currcmd = CMD_NONE;
 
+  if (pid > 0) {
+    init_process(pid);
+    running();
+  }
   init_content();
+  switch (notes_open(doc.filepath, doc.fd, theme.ntcolor)) {
+    case -1:
+      snprintf(message, sizeof(message), "notes: %s", strerror(errno));
+      break;
+    case NOTES_CHANGED:
+      snprintf(message, sizeof(message), "file changed since the notes");
+      break;
+    case NOTES_OTHER:
+      snprintf(message, sizeof(message), "notes of another file ignored");
+      break;
+  }
+  if (import != NULL) {
+    FILE *f = fopen(import, "r");
+    if (f == NULL) quit(1, import);
+    snprintf(message, sizeof(message), "%ld notes imported", notes_read(f));
+    fclose(f);
+    if (notes_save() == -1)
+      snprintf(message, sizeof(message), "notes: %s", strerror(errno));
+  }
+  if (gz_open(doc.filepath, doc.fd, doc.fdmem, doc.fsize))
+    gz_start();
+  ng_open(doc.filepath, doc.fd);
   running();
   quit(0, NULL);
 }
-
+#endif
@@ -0,0 +1,385 @@
+// n-gram index of big files that don't change, so that searching them
+// again only reads the blocks a pattern can be in. The file is cut in
+// NG_BLOCK blocks and the 4 byte grams starting in each (and in the
+// NG_OVER bytes after it, a pattern of up to NG_PAT bytes is then whole in
+// the block it starts in) are hashed to one of NG_HASH buckets. For every
+// group of NG_GROUP blocks and bucket the blocks having it are kept, as a
+// list of block numbers or a bitmap when there are many, so a search reads
+// the buckets of its grams and takes the blocks all of them have. That's
+// some 13% of the file at most. Blocks with more than NG_CAP buckets
+// (compressed or random data) wouldn't be left out of much: they are only
+// marked and always read. The index is built in the background into a
+// `.ngi` sidecar (see sidecar.h), valid while the file is the same inode,
+// size and mtime.
+#define NG_BLOCK (64L << 10)
+#define NG_GROUP 1024               // blocks, a chunk of the job
+#define NG_BITS  (NG_GROUP / 8)     // bytes of a bitmap of a group
+#define NG_LIST  (NG_BITS / 2)      // blocks a list has, at most
+#define NG_HASH  (1 << 16)
+#define NG_CAP   (NG_HASH / 2)      // buckets a block can have
+#define NG_PAT   16                 // longest pattern, as / takes them
+#define NG_OVER  (NG_PAT - 4)
+
+typedef struct nghead { // of the sidecar
+  char magic[8];
+  long size, ngroups, dir;  // dir: where the nggroup table is
+  unsigned long dev, ino;
+  long sec, nsec;
+} nghead;
+
+// a group is a uint32 count of rows, their sorted buckets (uint32) and
+// where each ends (uint32), then the rows: uint16 block numbers, or a
+// bitmap when it's NG_BITS long
+typedef struct nggroup {
+  long off, len;                // in the sidecar
+  unsigned char full[NG_BITS];  // blocks with too many buckets
+} nggroup;
+
+typedef struct ngjob {
+  job   j;
+  const unsigned char *mem;
+  long  size;
+  int   fd;      // of the sidecar being written, under a temporary name
+  long  end;     // where the next group goes, taken atomically
+  int   err;
+  nggroup *dir;
+  char  tmp[PATH_MAX + 4];
+} ngjob;
+
+static struct {
+  const unsigned char *mem;  // mapping of the sidecar, NULL without one
+  long  len;
+  nghead  *h;
+  nggroup *dir;
+  int   fd;                  // of the file
+  char  sidecar[PATH_MAX];
+} ngi;
+
+static unsigned ng_hash(const unsigned char *m)
+{
+  uint32_t g;
+
+  memcpy(&g, m, 4);
+  return (uint32_t)(g * 0x9E3779B1u) >> 16;
+}
+
+/* buckets of the grams starting in [from, to) not seen yet go to `got`,
+   -1 once there are more than NG_CAP */
+static int ng_grams(const unsigned char *m, long from, long to,
+  uint64_t *seen, uint16_t *got, int n)
+{
+  for (long i = from; i < to; i++) {
+    unsigned h = ng_hash(m + i);
+    if (seen[h >> 6] >> (h & 63) & 1) continue;
+    if (n == NG_CAP) return -1;
+    seen[h >> 6] |= 1ULL << (h & 63);
+    got[n++] = h;
+  }
+  return n;
+}
+
+/* buckets of block b, -1 when it has too many. Only the data extents are
+   read, grams reaching into them from a hole too; a hole anywhere has the
+   gram of zeros */
+static int ng_block(ngjob *g, long b, uint64_t *seen, uint16_t *got)
+{
+  static const unsigned char zeros[4];
+  long start = b * NG_BLOCK, end, lim, data = 0, a, e;
+  int n = 0;
+
+  end = (g->size - start < NG_BLOCK ? g->size : start + NG_BLOCK);
+  lim = (g->size - 3 < end + NG_OVER ? g->size - 3 : end + NG_OVER);
+  for (a = start; n != -1 && (a = ext_data(a, lim + 3, &e)) != -1; a = e) {
+    long from = (a - start < 3 ? start : a - 3), to = (e < lim ? e : lim);
+    data += e - a;
+    if (from < to) n = ng_grams(g->mem, from, to, seen, got, n);
+  }
+  if (n != -1 && lim > start && data < lim + 3 - start)
+    n = ng_grams(zeros, 0, 1, seen, got, n);
+  for (int i = 0; i < (n == -1 ? NG_CAP : n); i++)
+    seen[got[i] >> 6] = 0;
+  return n;
+}
+
+/* the rows of a group from the buckets of its blocks, to the sidecar */
+static int ng_group(ngjob *g, long c, unsigned char *rows, uint32_t *cnt,
+  uint16_t *got)
+{
+  nggroup *d = &g->dir[c];
+  long nb = (g->size + NG_BLOCK - 1) / NG_BLOCK - c*NG_GROUP, nrows = 0, len;
+  uint32_t *bucket, *end, o = 0;
+  unsigned char *blob, *row;
+  uint64_t seen[NG_HASH / 64];
+
+  memset(seen, 0, sizeof(seen));
+  memset(cnt, 0, sizeof(uint32_t) * NG_HASH);
+  memset(rows, 0, (long)NG_HASH * NG_BITS);
+  if (nb > NG_GROUP) nb = NG_GROUP;
+  for (long b = 0; b < nb; b++) {
+    int n;
+    if (job_cancelled(&g->j)) return 0;
+    if ((n = ng_block(g, c*NG_GROUP + b, seen, got)) == -1)
+      d->full[b / 8] |= 1 << b % 8;
+    for (int i = 0; i < n; i++) {
+      rows[(long)got[i]*NG_BITS + b/8] |= 1 << b % 8;
+      cnt[got[i]]++;
+    }
+  }
+  len = 4;
+  for (long h = 0; h < NG_HASH; h++)
+    if (cnt[h] > 0) {
+      nrows++;
+      len += 8 + (cnt[h] < NG_LIST ? 2*cnt[h] : NG_BITS);
+    }
+  len = (len + 7) & ~7L; // groups stay aligned in the sidecar
+  if ((blob = calloc(1, len)) == NULL) return -1;
+  *(uint32_t *)blob = nrows;
+  bucket = (uint32_t *)(blob + 4);
+  end    = bucket + nrows;
+  row    = (unsigned char *)(end + nrows);
+  for (long h = 0, r = 0; h < NG_HASH; h++) {
+    const unsigned char *bits = rows + h*NG_BITS;
+    if (cnt[h] == 0) continue;
+    bucket[r] = h;
+    if (cnt[h] < NG_LIST) {
+      for (uint16_t b = 0; b < NG_GROUP; b++)
+        if (bits[b / 8] >> b % 8 & 1) {
+          memcpy(row + o, &b, 2);
+          o += 2;
+        }
+    } else {
+      memcpy(row + o, bits, NG_BITS);
+      o += NG_BITS;
+    }
+    end[r++] = o;
+  }
+  d->len = len;
+  d->off = __atomic_fetch_add(&g->end, len, __ATOMIC_RELAXED);
+  if (pwrite(g->fd, blob, len, d->off) != len) {
+    free(blob);
+    return -1;
+  }
+  free(blob);
+  return 0;
+}
+
+static void ng_chunk(job *j, long c)
+{
+  ngjob *g = (ngjob *)j;
+  unsigned char *rows = malloc((long)NG_HASH * NG_BITS);
+  uint32_t *cnt = malloc(sizeof(uint32_t) * NG_HASH);
+  uint16_t *got = malloc(sizeof(uint16_t) * NG_CAP);
+
+  if (rows == NULL || cnt == NULL || got == NULL ||
+      ng_group(g, c, rows, cnt, got) == -1)
+    __atomic_store_n(&g->err, (errno != 0 ? errno : EIO), __ATOMIC_RELAXED);
+  free(rows);
+  free(cnt);
+  free(got);
+}
+
+static void ng_worker(long i, void *arg) /* for pool_run */
+{
+  ng_chunk(arg, i);
+}
+
+static int ng_same(nghead *h) /* the sidecar is about this very file */
+{
+  struct stat st;
+
+  return (fstat(ngi.fd, &st) == 0 && memcmp(h->magic, "hexngi1", 8) == 0 &&
+    h->size == st.st_size && h->dev == st.st_dev && h->ino == st.st_ino &&
+    h->sec == st.st_mtim.tv_sec && h->nsec == st.st_mtim.tv_nsec);
+}
+
+static int ng_load(void) /* the index from the sidecar, -1 if there's none */
+{
+  struct stat st;
+  unsigned char *m;
+  nghead *h;
+  nggroup *d;
+  int fd, ok;
+
+  if (*ngi.sidecar == '\0' || (fd = open(ngi.sidecar, O_RDONLY)) == -1)
+    return -1;
+  if (fstat(fd, &st) == -1 || st.st_size < (long)sizeof(nghead) ||
+      (m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+      MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  h = (nghead *)m;
+  ok = (ng_same(h) && h->ngroups ==
+    (h->size + NG_BLOCK*NG_GROUP - 1) / (NG_BLOCK*NG_GROUP) &&
+    h->dir >= (long)sizeof(nghead) && h->dir % 8 == 0 &&
+    h->dir <= st.st_size &&
+    h->ngroups <= (st.st_size - h->dir) / (long)sizeof(nggroup));
+  d = (nggroup *)(m + (ok ? h->dir : 0));
+  for (long g = 0; ok && g < h->ngroups; g++)
+    ok = (d[g].off >= (long)sizeof(nghead) && d[g].off % 8 == 0 &&
+      d[g].len >= 4 && d[g].len <= st.st_size - d[g].off);
+  if (!ok) {
+    munmap(m, st.st_size);
+    return -1;
+  }
+  if (ngi.mem != NULL) munmap((void *)ngi.mem, ngi.len);
+  ngi.mem = m;
+  ngi.len = st.st_size;
+  ngi.h   = h;
+  ngi.dir = d;
+  return 0;
+}
+
+/* looks for the index of the file, 0 when there's one */
+static int ng_open(const char *file, int fd)
+{
+  char real[PATH_MAX];
+
+  ngi.fd = fd;
+  *ngi.sidecar = '\0';
+  if (realpath(file, real) == NULL ||
+      sidecar_path(real, "ngi", ngi.sidecar, sizeof(ngi.sidecar)) == -1)
+    return -1;
+  return ng_load();
+}
+
+/* NULL if there's nothing to index or no place for it */
+static ngjob *ng_new(const char *mem, long size, void (*deliver)(job *))
+{
+  ngjob *g;
+
+  if (mem == NULL || size <= 0 || *ngi.sidecar == '\0') {
+    errno = ENOENT;
+    return NULL;
+  }
+  if ((g = calloc(1, sizeof(ngjob))) == NULL) return NULL;
+  g->j = (job){
+    .name = "index",
+    .nchunks = (size + NG_BLOCK*NG_GROUP - 1) / (NG_BLOCK*NG_GROUP),
+    .run = ng_chunk,
+    .deliver = deliver
+  };
+  g->mem  = (const unsigned char *)mem;
+  g->size = size;
+  g->end  = sizeof(nghead);
+  snprintf(g->tmp, sizeof(g->tmp), "%s.tmp", ngi.sidecar);
+  if ((g->dir = calloc(g->j.nchunks, sizeof(nggroup))) == NULL ||
+      (g->fd = open(g->tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1) {
+    free(g->dir);
+    free(g);
+    return NULL;
+  }
+  return g;
+}
+
+/* the sidecar of a finished job, then the index from it; -1 on errors or
+   when it was cancelled */
+static int ng_finish(ngjob *g)
+{
+  nghead h = { "hexngi1", g->size, g->j.nchunks, g->end };
+  long dir = sizeof(nggroup) * g->j.nchunks;
+  struct stat st;
+  int ok = (!job_cancelled(&g->j) && g->err == 0), err = g->err;
+
+  if (ok && fstat(ngi.fd, &st) == 0) {
+    h.dev  = st.st_dev;
+    h.ino  = st.st_ino;
+    h.sec  = st.st_mtim.tv_sec;
+    h.nsec = st.st_mtim.tv_nsec;
+    ok = (pwrite(g->fd, g->dir, dir, g->end) == dir &&
+      pwrite(g->fd, &h, sizeof(h), 0) == sizeof(h));
+  } else {
+    ok = 0;
+  }
+  if (!ok && err == 0) err = errno;
+  if (close(g->fd) == -1 && ok) {
+    err = errno;
+    ok = 0;
+  }
+  if (ok && rename(g->tmp, ngi.sidecar) == -1) {
+    err = errno;
+    ok = 0;
+  }
+  if (!ok) {
+    unlink(g->tmp);
+    errno = err;
+    return -1;
+  }
+  return ng_load();
+}
+
+static void ng_free(ngjob *g)
+{
+  free(g->dir);
+  free(g);
+}
+
+/* blocks of the index always read */
+static long ng_full(void)
+{
+  long n = 0;
+
+  for (long g = 0; ngi.h != NULL && g < ngi.h->ngroups; g++)
+    for (int i = 0; i < NG_BITS; i++)
+      n += __builtin_popcount(ngi.dir[g].full[i]);
+  return n;
+}
+
+/* the blocks of group g with bucket h into `row`, all of them when the
+   group doesn't make sense */
+static void ng_row(long g, unsigned h, unsigned char *row)
+{
+  nggroup *d = &ngi.dir[g];
+  const unsigned char *b = ngi.mem + d->off, *data;
+  const uint32_t *bucket = (const uint32_t *)(b + 4), *end;
+  uint32_t rows = *(const uint32_t *)b, lo = 0, hi = rows, from;
+
+  if (rows > (d->len - 4) / 8) {
+    memset(row, 0xff, NG_BITS);
+    return;
+  }
+  memset(row, 0, NG_BITS);
+  end  = bucket + rows;
+  data = (const unsigned char *)(end + rows);
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (bucket[mid] < h) lo = mid + 1; else hi = mid;
+  }
+  if (lo == rows || bucket[lo] != h) return;
+  from = (lo > 0 ? end[lo - 1] : 0);
+  if (end[lo] < from || end[lo] > d->len - 4 - 8*rows) {
+    memset(row, 0xff, NG_BITS);
+  } else if (end[lo] - from == NG_BITS) {
+    memcpy(row, data + from, NG_BITS);
+  } else {
+    for (uint32_t i = from; i + 2 <= end[lo]; i += 2) {
+      uint16_t k;
+      memcpy(&k, data + i, 2);
+      if (k < NG_GROUP) row[k / 8] |= 1 << k % 8;
+    }
+  }
+}
+
+/* bitmap of the blocks a match of `pat` can start in (bit i of byte i/8
+   for block i), NULL when the index can't tell: there's none, or the
+   pattern is too short or too long for it */
+static unsigned char *ng_candidates(const unsigned char *pat, int len)
+{
+  unsigned char *c, row[NG_BITS];
+
+  if (ngi.h == NULL || len < 4 || len > NG_PAT) return NULL;
+  if ((c = malloc(ngi.h->ngroups * NG_BITS)) == NULL) return NULL;
+  for (long g = 0; g < ngi.h->ngroups; g++) {
+    unsigned char *out = c + g*NG_BITS;
+    memset(out, 0xff, NG_BITS);
+    for (int i = 0; i + 4 <= len; i++) {
+      ng_row(g, ng_hash(pat + i), row);
+      for (int k = 0; k < NG_BITS; k++)
+        out[k] &= row[k];
+    }
+    for (int k = 0; k < NG_BITS; k++)
+      out[k] |= ngi.dir[g].full[k];
+  }
+  return c;
+}
@@ -0,0 +1,151 @@
+// named bookmarks and range notes. They live as HL_NOTE spans in the
+// highlight index (span data is the note id), the texts here. Every file
+// gets a `.notes` sidecar (see sidecar.h); it holds path, inode and mtime
+// of the file so notes of some other file that took the path are not shown,
+// and changes made elsewhere are told (the session's own edits aren't).
+//
+//   hexing notes 1
+//   path /real/path
+//   inode <dev> <ino>
+//   mtime <sec>.<nsec>
+//   <start> <end> <text>      hex offsets, end not included
+enum {
+  NOTES_OK = 0,
+  NOTES_CHANGED,   // same file, modified since the notes were saved
+  NOTES_OTHER      // another file is at that path now, notes not loaded
+};
+
+static struct {
+  char **text;     // by id, NULL once removed
+  long   n, cap;
+  char   sidecar[PATH_MAX], path[PATH_MAX];
+  int    fd;
+  int    fresh;    // the sidecar has the mtime the file had, see notes_touch
+  unsigned int color;
+} notes;
+
+static long notes_add(long start, long end, const char *text)
+{
+  char *t;
+
+  if (start >= end) return -1;
+  if (notes.n == notes.cap) {
+    char **n = realloc(notes.text,
+      sizeof(char *) * (notes.cap = notes.cap*2 + 64));
+    if (n == NULL) return -1;
+    notes.text = n;
+  }
+  if ((t = strdup(text)) == NULL) return -1;
+  for (char *c = t; *c; c++) // one line each in the sidecar
+    if (*c == '\n' || *c == '\r') *c = ' ';
+  if (hl_add(start, end, HL_NOTE, notes.color, notes.n) == -1) {
+    free(t);
+    return -1;
+  }
+  notes.text[notes.n] = t;
+  return notes.n++;
+}
+
+static void notes_remove(long id)
+{
+  hl_remove(HL_NOTE, id);
+  free(notes.text[id]);
+  notes.text[id] = NULL;
+}
+
+/* the innermost note over `off` (the one starting last) */
+static span *notes_at(long off)
+{
+  span *s[64], *best = NULL;
+  int k = hl_query(off, 1, s, 64);
+
+  for (int i = 0; i < k; i++)
+    if (s[i]->layer == HL_NOTE) best = s[i];
+  return best;
+}
+
+/* `<start> <end> <text>` lines, anything else is skipped */
+static long notes_read(FILE *f)
+{
+  char line[1024];
+  unsigned long start, end;
+  long added = 0;
+  int n;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    if (sscanf(line, "%lx %lx %n", &start, &end, &n) < 2) continue;
+    if (notes_add(start, end, line + n) != -1) added++;
+  }
+  return added;
+}
+
+static int notes_save(void)
+{
+  char tmp[PATH_MAX + 4];
+  struct stat st;
+  FILE *f;
+
+  if (*notes.sidecar == '\0' || fstat(notes.fd, &st) == -1) return -1;
+  snprintf(tmp, sizeof(tmp), "%s.tmp", notes.sidecar);
+  if ((f = fopen(tmp, "w")) == NULL) return -1;
+  fprintf(f, "hexing notes 1\npath %s\ninode %lu %lu\nmtime %ld.%09ld\n",
+    notes.path, (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+    (long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+  if (hl.dirty) hl_index(); // by start
+  for (long i = 0; i < hl.n; i++)
+    if (hl.s[i].layer == HL_NOTE)
+      fprintf(f, "%lx %lx %s\n", hl.s[i].start, hl.s[i].end,
+        notes.text[hl.s[i].data]);
+  if (fclose(f) == EOF || rename(tmp, notes.sidecar) == -1) {
+    unlink(tmp);
+    return -1;
+  }
+  notes.fresh = 1;
+  return 0;
+}
+
+/* after the session's own edits: the notes still hold, so the sidecar
+   takes the mtime they left unless it was stale already */
+static void notes_touch(void)
+{
+  if (notes.fresh) notes_save();
+}
+
+/* finds and loads the sidecar of `file`, -1 when there's no place for it */
+static int notes_open(const char *file, int fd, unsigned int color)
+{
+  char line[PATH_MAX + 16];
+  unsigned long dev = 0, ino = 0;
+  long sec = 0, nsec = 0;
+  struct stat st;
+  int r = NOTES_OK;
+  FILE *f;
+
+  notes.fd = fd;
+  notes.color = color;
+  if (realpath(file, notes.path) == NULL || fstat(fd, &st) == -1) return -1;
+  if (sidecar_path(notes.path, "notes", notes.sidecar,
+      sizeof(notes.sidecar)) == -1)
+    return -1;
+
+  if ((f = fopen(notes.sidecar, "r")) == NULL) return NOTES_OK;
+  while (fgets(line, sizeof(line), f) != NULL) { // header
+    line[strcspn(line, "\n")] = '\0';
+    if (strncmp(line, "path ", 5) == 0 && strcmp(line + 5, notes.path) != 0)
+      r = NOTES_OTHER; // a hash collision, as good as another file
+    sscanf(line, "inode %lu %lu", &dev, &ino);
+    if (sscanf(line, "mtime %ld.%ld", &sec, &nsec) == 2) break;
+  }
+  if (dev != st.st_dev || ino != st.st_ino) r = NOTES_OTHER;
+  if (r == NOTES_OTHER) {
+    fclose(f);
+    return r;
+  }
+  if (sec != st.st_mtim.tv_sec || nsec != st.st_mtim.tv_nsec)
+    r = NOTES_CHANGED;
+  notes_read(f);
+  fclose(f);
+  notes.fresh = (r == NOTES_OK);
+  return r;
+}
@@ -0,0 +1,260 @@
+// batch patching: a script of edits applied to many files through edit.h
+//
+// one edit per line, `#` starts a comment:
+//   <offset>            <bytes> [<expected>]
+//   =<pattern>[+-delta] <bytes> [<expected>]
+// offsets take C notation (0x1f40), bytes are plain hex (9090) and patterns
+// may use `??` as a wildcard. Pattern edits apply at every match.
+#define PATCH_CHUNK (1 << 20)
+
+enum {
+  PATCH_OK = 0,
+  PATCH_MISMATCH,
+  PATCH_NOTFOUND,
+  PATCH_ERROR
+};
+
+typedef struct patchent {
+  long off;                  // -1 when there's a pattern
+  unsigned char *pat, *mask;
+  int  patlen, first;        // first non wildcard byte of the pattern
+  long delta;                // from the pattern match to the edit
+  unsigned char *bytes, *expect;
+  int  len, explen;
+  int  line;
+} patchent;
+
+typedef struct patchsite {
+  long off;
+  int  ent;
+} patchsite;
+
+typedef struct patchreport {
+  int  status, line;
+  long off, applied, already;
+  int  err;
+} patchreport;
+
+typedef struct patchjob {
+  patchent    *ent;
+  int          nent, dry;
+  char       **files;
+  patchreport *rep;
+} patchjob;
+
+/* hex digits to bytes, `mask` (when not NULL) allows `??` wildcards */
+static int patch_hex(const char *s, unsigned char **d, unsigned char **mask,
+  int *len)
+{
+  int n = strlen(s);
+
+  if (n == 0 || n % 2 != 0) return -1;
+  *len = n/2;
+  *d   = malloc(n/2);
+  if (mask != NULL) *mask = malloc(n/2);
+  if (*d == NULL || (mask != NULL && *mask == NULL)) return -1;
+  for (int i = 0; i < n/2; i++) {
+    if (mask != NULL) {
+      (*mask)[i] = !(s[i*2] == '?' && s[i*2+1] == '?');
+      if (!(*mask)[i]) { (*d)[i] = 0; continue; }
+    }
+    if (fmt_unhex(s + i*2, *d + i, 1) == -1) return -1;
+  }
+  return 0;
+}
+
+/* returns the amount of entries or -1 with `*line` at the bad line */
+static int patch_parse(FILE *f, patchent **ents, int *line)
+{
+  char buf[4096];
+  int n = 0, cap = 0;
+
+  *ents = NULL;
+  *line = 0;
+  while (fgets(buf, sizeof(buf), f) != NULL) {
+    char *tok[4], *save = NULL, *c = strchr(buf, '#');
+    int ntok = 0;
+    patchent p = { .off = -1 };
+
+    ++*line;
+    if (c != NULL) *c = '\0';
+    for (char *t = strtok_r(buf, " \t\r\n", &save); t != NULL && ntok < 4;
+        t = strtok_r(NULL, " \t\r\n", &save))
+      tok[ntok++] = t;
+    if (ntok == 0) continue;
+    if (ntok < 2 || ntok > 3) return -1;
+
+    p.line = *line;
+    if (*tok[0] == '=') {
+      char *d = strpbrk(tok[0], "+-");
+      if (d != NULL) {
+        p.delta = strtol(d, NULL, 0);
+        *d = '\0';
+      }
+      if (patch_hex(tok[0] + 1, &p.pat, &p.mask, &p.patlen) == -1)
+        return -1;
+      for (p.first = 0; p.first < p.patlen && !p.mask[p.first]; p.first++)
+        ;
+      if (p.first == p.patlen) return -1; // only wildcards
+    } else {
+      char *end;
+      p.off = strtol(tok[0], &end, 0);
+      if (*end != '\0' || p.off < 0) return -1;
+    }
+    if (patch_hex(tok[1], &p.bytes, NULL, &p.len) == -1) return -1;
+    if (ntok == 3 && patch_hex(tok[2], &p.expect, NULL, &p.explen) == -1)
+      return -1;
+
+    if (n == cap) {
+      patchent *e = realloc(*ents, sizeof(patchent) * (cap = cap*2 + 16));
+      if (e == NULL) return -1;
+      *ents = e;
+    }
+    (*ents)[n++] = p;
+  }
+  return n;
+}
+
+static int patch_addsite(patchsite **s, int *n, int *cap, long off, int ent)
+{
+  if (*n == *cap) {
+    patchsite *ns = realloc(*s, sizeof(patchsite) * (*cap = *cap*2 + 16));
+    if (ns == NULL) return -1;
+    *s = ns;
+  }
+  (*s)[(*n)++] = (patchsite){ off, ent };
+  return 0;
+}
+
+/* every match of the pattern of `p`, reading the file in chunks */
+static int patch_find(edit *e, patchent *p, int ent, patchsite **s, int *n,
+  int *cap)
+{
+  unsigned char *buf = malloc(PATCH_CHUNK + p->patlen);
+  int found = 0;
+
+  if (buf == NULL) return -1;
+  for (long base = 0; base + p->patlen <= e->size; base += PATCH_CHUNK) {
+    long len = PATCH_CHUNK + p->patlen - 1;
+    if (len > e->size - base) len = e->size - base;
+    if (edit_read(e, base, buf, len) == -1) { free(buf); return -1; }
+
+    for (long i = 0; i + p->patlen <= len && i < PATCH_CHUNK; i++) {
+      unsigned char *c = memchr(buf + i + p->first, p->pat[p->first],
+        len - p->patlen + 1 - i);
+      if (c == NULL) break;
+      i = c - buf - p->first;
+      if (i >= PATCH_CHUNK) break;
+      int k = 0;
+      for (; k < p->patlen; k++)
+        if (p->mask[k] && buf[i+k] != p->pat[k]) break;
+      if (k == p->patlen) {
+        if (patch_addsite(s, n, cap, base + i + p->delta, ent) == -1) {
+          free(buf); return -1;
+        }
+        found++;
+      }
+    }
+  }
+  free(buf);
+  return found;
+}
+
+/* check every site before writing any of them, a file is all or nothing */
+static void patch_file(edit *e, patchjob *job, patchreport *rep)
+{
+  patchsite *s = NULL;
+  int n = 0, cap = 0;
+  unsigned char cur[4096];
+
+  for (int i = 0; i < job->nent; i++) {
+    patchent *p = &job->ent[i];
+    if (p->off >= 0) {
+      if (patch_addsite(&s, &n, &cap, p->off, i) == -1) goto error;
+    } else {
+      int r = patch_find(e, p, i, &s, &n, &cap);
+      if (r == -1) goto error;
+      if (r == 0) {
+        rep->status = PATCH_NOTFOUND; rep->line = p->line;
+        goto done;
+      }
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    patchent *p = &job->ent[s[i].ent];
+    int len = (p->len > p->explen ? p->len : p->explen);
+    if (len > sizeof(cur) || edit_read(e, s[i].off, cur, len) == -1 ||
+        (memcmp(cur, p->bytes, p->len) != 0 && p->expect != NULL &&
+         memcmp(cur, p->expect, p->explen) != 0)) {
+      rep->status = PATCH_MISMATCH; rep->line = p->line; rep->off = s[i].off;
+      goto done;
+    }
+    if (memcmp(cur, p->bytes, p->len) == 0) { // already patched
+      rep->already++;
+      s[i].ent = -1;
+    }
+  }
+
+  for (int i = 0; i < n && !job->dry; i++) {
+    if (s[i].ent == -1) continue;
+    patchent *p = &job->ent[s[i].ent];
+    if (edit_write(e, s[i].off, p->bytes, p->len) == -1) goto error;
+    rep->applied++;
+  }
+  if (job->dry)
+    rep->applied = n - rep->already;
+  goto done;
+
+error:
+  rep->status = PATCH_ERROR;
+  rep->err    = errno;
+done:
+  free(s);
+}
+
+static void patch_worker(long i, void *arg)
+{
+  patchjob *job = arg;
+  patchreport *rep = &job->rep[i];
+  struct stat st;
+  edit e = { .mem = NULL };
+
+  e.fd = open(job->files[i], job->dry ? O_RDONLY : O_RDWR);
+  if (e.fd == -1 || fstat(e.fd, &st) == -1) {
+    rep->status = PATCH_ERROR;
+    rep->err    = errno;
+  } else {
+    e.size = st.st_size;
+    patch_file(&e, job, rep);
+  }
+  if (e.fd != -1) close(e.fd);
+}
+
+/* one line per file to `out`, returns the amount of files that failed */
+static int patch_report(FILE *out, patchjob *job, int nfiles)
+{
+  int failed = 0;
+
+  for (int i = 0; i < nfiles; i++) {
+    patchreport *r = &job->rep[i];
+    fprintf(out, "%s: ", job->files[i]);
+    switch (r->status) {
+      case PATCH_OK:
+        fprintf(out, "ok, %ld %s, %ld already\n", r->applied,
+          job->dry ? "pending" : "applied", r->already);
+        break;
+      case PATCH_MISMATCH:
+        fprintf(out, "mismatch at %#lx (line %d), untouched\n", r->off,
+          r->line);
+        break;
+      case PATCH_NOTFOUND:
+        fprintf(out, "pattern of line %d not found, untouched\n", r->line);
+        break;
+      default:
+        fprintf(out, "%s\n", strerror(r->err));
+    }
+    failed += (r->status != PATCH_OK);
+  }
+  return failed;
+}
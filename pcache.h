@@ -0,0 +1,187 @@
+// a bounded page cache in front of what can't be mapped (a live process, a
+// decompressed stream). Least recently used pages go first. The missing
+// pages of a window are read with one call to the source per run of them,
+// with the neighbours prefetched in that same call.
+#define PC_PAGE     4096
+#define PC_PAGES    2048  // 8 MiB
+#define PC_BUCKETS  4096
+#define PC_PREFETCH 16    // pages each side
+
+typedef struct pcpage {
+  long page;
+  int  prev, next;    // lru list, most recent first
+  int  hnext;         // bucket chain
+  int  ok;            // read fine, zeros otherwise
+  uint64_t stamp;     // when it was read
+} pcpage;
+
+typedef struct pcache {
+  long size;
+  // reads `n` pages from `page` on into `bufs`, sets ok[] of the readable
+  void (*fill)(void *arg, long page, int n, unsigned char **bufs, char *ok);
+  void *arg;
+  uint64_t maxage;    // ns, older pages are read again, 0 keeps them
+  pcpage *p;
+  unsigned char *data;
+  int *bucket, head, tail, used;
+  // what pcache_window() returns, bad[i] set for unreadable bytes
+  unsigned char *win, *bad;
+  long caplen;
+  long fills, pages;  // calls to fill and pages read so far
+} pcache;
+
+static int pcache_init(pcache *pc, long size,
+  void (*fill)(void *, long, int, unsigned char **, char *), void *arg,
+  uint64_t maxage)
+{
+  *pc = (pcache){ .size = size, .fill = fill, .arg = arg, .maxage = maxage,
+    .head = -1, .tail = -1 };
+  pc->p      = calloc(PC_PAGES, sizeof(pcpage));
+  pc->data   = malloc((long)PC_PAGES * PC_PAGE);
+  pc->bucket = malloc(sizeof(int) * PC_BUCKETS);
+  if (pc->p == NULL || pc->data == NULL || pc->bucket == NULL) return -1;
+  memset(pc->bucket, -1, sizeof(int) * PC_BUCKETS);
+  return 0;
+}
+
+static void pcache_unlink(pcache *pc, int s)
+{
+  pcpage *p = &pc->p[s];
+
+  if (p->prev != -1) pc->p[p->prev].next = p->next; else pc->head = p->next;
+  if (p->next != -1) pc->p[p->next].prev = p->prev; else pc->tail = p->prev;
+}
+
+static void pcache_front(pcache *pc, int s)
+{
+  pc->p[s].prev = -1;
+  pc->p[s].next = pc->head;
+  if (pc->head != -1) pc->p[pc->head].prev = s;
+  pc->head = s;
+  if (pc->tail == -1) pc->tail = s;
+}
+
+static int pcache_find(pcache *pc, long page)
+{
+  int s = pc->bucket[page % PC_BUCKETS];
+
+  while (s != -1 && pc->p[s].page != page)
+    s = pc->p[s].hnext;
+  return s;
+}
+
+/* a slot for `page`, the one it has or the least recently used */
+static int pcache_slot(pcache *pc, long page)
+{
+  int s = pcache_find(pc, page), *h;
+
+  if (s != -1) {
+    pcache_unlink(pc, s);
+    pcache_front(pc, s);
+    return s;
+  }
+  if (pc->used < PC_PAGES) {
+    s = pc->used++;
+  } else {
+    s = pc->tail;
+    pcache_unlink(pc, s);
+    for (h = &pc->bucket[pc->p[s].page % PC_BUCKETS]; *h != s;
+        h = &pc->p[*h].hnext)
+      ;
+    *h = pc->p[s].hnext;
+  }
+  pc->p[s] = (pcpage){ .page = page, .stamp = 0,
+    .hnext = pc->bucket[page % PC_BUCKETS] };
+  pc->bucket[page % PC_BUCKETS] = s;
+  pcache_front(pc, s);
+  return s;
+}
+
+static int pcache_fresh(pcache *pc, long page, uint64_t now)
+{
+  int s = pcache_find(pc, page);
+  return (s != -1 && pc->p[s].stamp != 0 &&
+    (pc->maxage == 0 || now - pc->p[s].stamp < pc->maxage));
+}
+
+/* reads the pages [first, last] that are missing or too old */
+static void pcache_load(pcache *pc, long first, long last)
+{
+  uint64_t now = prof_now();
+  long npages = (pc->size + PC_PAGE - 1) / PC_PAGE, lo = -1, hi = -1;
+
+  for (long pg = first; pg <= last; pg++)
+    if (pcache_fresh(pc, pg, now)) {
+      pcache_slot(pc, pg); // recently used, not what the run evicts
+    } else {
+      if (lo == -1) lo = pg;
+      hi = pg;
+    }
+  if (lo == -1) return;
+  // neighbours on both sides, up to the first page already there
+  for (int k = 0; k < PC_PREFETCH && lo > 0 && !pcache_fresh(pc, lo-1, now);
+      k++)
+    lo--;
+  for (int k = 0; k < PC_PREFETCH && hi < npages - 1 &&
+      !pcache_fresh(pc, hi+1, now); k++)
+    hi++;
+  if (hi - lo + 1 > PC_PAGES / 2) hi = lo + PC_PAGES/2 - 1;
+
+  {
+    int n = hi - lo + 1, slot[n];
+    unsigned char *bufs[n];
+    char ok[n];
+    for (int i = 0; i < n; i++) {
+      slot[i] = pcache_slot(pc, lo + i);
+      bufs[i] = pc->data + (long)slot[i] * PC_PAGE;
+      ok[i] = 0;
+    }
+    pc->fill(pc->arg, lo, n, bufs, ok);
+    pc->fills++;
+    pc->pages += n;
+    for (int i = 0; i < n; i++) {
+      pc->p[slot[i]].stamp = now;
+      if (!(pc->p[slot[i]].ok = ok[i])) memset(bufs[i], 0, PC_PAGE);
+    }
+  }
+}
+
+/* [off, off+len) in one buffer, valid until the next call */
+static const unsigned char *pcache_window(pcache *pc, long off, long len)
+{
+  long first, last;
+
+  if (off + len > pc->size) len = pc->size - off;
+  if (len <= 0) return pc->win;
+  if (len > pc->caplen) {
+    unsigned char *w = realloc(pc->win, len), *b;
+    if (w == NULL) return NULL;
+    pc->win = w;
+    if ((b = realloc(pc->bad, len)) == NULL) return NULL;
+    pc->bad = b;
+    pc->caplen = len;
+  }
+  first = off / PC_PAGE;
+  last  = (off + len - 1) / PC_PAGE;
+  pcache_load(pc, first, last);
+  for (long pg = first; pg <= last; pg++) {
+    int s = pcache_find(pc, pg);
+    long a = (pg*PC_PAGE > off ? pg*PC_PAGE : off),
+         b = ((pg+1)*PC_PAGE < off + len ? (pg+1)*PC_PAGE : off + len);
+    if (s == -1) { // only when the window is bigger than the cache
+      memset(pc->win + (a - off), 0, b - a);
+      memset(pc->bad + (a - off), 1, b - a);
+      continue;
+    }
+    memcpy(pc->win + (a - off), pc->data + (long)s*PC_PAGE + (a - pg*PC_PAGE),
+      b - a);
+    memset(pc->bad + (a - off), !pc->p[s].ok, b - a);
+  }
+  return pc->win;
+}
+
+static void pcache_drop(pcache *pc) /* everything is read again */
+{
+  for (int i = 0; i < pc->used; i++)
+    pc->p[i].stamp = 0;
+}
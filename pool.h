@@ -0,0 +1,42 @@
+// tiny worker pool: run fn(i) for every i in [0, n) on a few threads.
+#include <pthread.h>
+
+typedef struct pool {
+  long n;
+  long next;  // next index to hand out, taken atomically
+  void (*fn)(long i, void *arg);
+  void *arg;
+} pool;
+
+static void *pool_worker(void *p)
+{
+  pool *pl = p;
+  long i;
+
+  while ((i = __atomic_fetch_add(&pl->next, 1, __ATOMIC_RELAXED)) < pl->n)
+    pl->fn(i, pl->arg);
+  return NULL;
+}
+
+static int pool_threads(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n < 1 ? 1 : (n > 64 ? 64 : n));
+}
+
+/* blocks until every index is done, the calling thread works too */
+static void pool_run(long n, int threads, void (*fn)(long, void *), void *arg)
+{
+  pool pl = { .n = n, .fn = fn, .arg = arg };
+  pthread_t tid[64];
+  int started = 0;
+
+  if (threads > n) threads = n;
+  if (threads > 64) threads = 64;
+  for (; started < threads - 1; started++)
+    if (pthread_create(&tid[started], NULL, pool_worker, &pl) != 0)
+      break;
+  pool_worker(&pl);
+  for (int i = 0; i < started; i++)
+    pthread_join(tid[i], NULL);
+}
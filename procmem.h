@@ -0,0 +1,56 @@
+// a running process as the document: offsets are addresses. The readable
+// regions of /proc/N/maps become the segments of vaddr.h (so paging skips
+// the rest) and bytes come from process_vm_readv through the page cache,
+// a whole run of pages per call.
+#include <sys/uio.h>
+
+static struct {
+  pid_t pid;
+} proc;
+
+/* reads the regions, returns the end of the last one or -1 */
+static long proc_open(pid_t pid)
+{
+  char path[64], line[PATH_MAX + 128];
+  unsigned long start, end, last = 0;
+  char perms[5];
+  FILE *f;
+
+  proc.pid = pid;
+  snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+  if ((f = fopen(path, "r")) == NULL) return -1;
+  va.n = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) != 3) continue;
+    if (perms[0] != 'r' || end > LONG_MAX) continue;
+    va_add(start, start, end - start, LONG_MAX);
+    if (end > last) last = end;
+  }
+  fclose(f);
+  va_index();
+  return (va.n > 0 ? (long)last : -1);
+}
+
+/* one call for every mapped run, a page that can't be read is skipped */
+static void proc_fill(void *arg, long page, int n, unsigned char **bufs,
+  char *ok)
+{
+  struct iovec local[n], remote;
+
+  for (int i = 0; i < n; ) {
+    ssize_t r;
+    int k;
+    for (k = 0; i + k < n && va_mapped((page + i + k) * PC_PAGE, PC_PAGE); k++)
+      local[k] = (struct iovec){ bufs[i + k], PC_PAGE };
+    if (k == 0) { // not mapped, no need to ask
+      i++;
+      continue;
+    }
+    remote = (struct iovec){ (void *)((page + i) * PC_PAGE),
+      (size_t)k * PC_PAGE };
+    if ((r = process_vm_readv(proc.pid, local, k, &remote, 1, 0)) < 0) r = 0;
+    for (int j = 0; j < r / PC_PAGE; j++)
+      ok[i + j] = 1;
+    i += r / PC_PAGE + (r / PC_PAGE < k); // past the one that failed
+  }
+}
@@ -0,0 +1,103 @@
+// frame instrumentation: time per phase, counters per frame, an optional
+// chrome trace-event json stream (chrome://tracing, perfetto).
+#include <time.h>
+#include <sys/resource.h>
+
+enum {
+  PROF_EVENTS = 0,
+  PROF_CONTENT,
+  PROF_GLYPHS,     // inside the others, every draw_text()
+  PROF_OFFSETCOL,
+  PROF_INFOBAR,
+  PROF_HUD,
+  PROF_PRESENT,
+  PROF_PHASES
+};
+
+static const char *prof_names[PROF_PHASES] = {
+  "events", "content", "glyphs", "offsetcol", "infobar", "hud", "present"
+};
+
+static struct {
+  int   hud;
+  FILE *trace;
+  long  frame;
+  uint64_t t0, frame_start;
+  uint64_t start[PROF_PHASES], acc[PROF_PHASES];  // ns, this frame
+  long  draws, faults;                            // this frame
+  // smoothed over the last frames, what the hud shows
+  double avg[PROF_PHASES], avg_frame, avg_draws, avg_faults;
+} prof;
+
+static uint64_t prof_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static long prof_faults(void) /* of the calling (ui) thread */
+{
+  struct rusage ru;
+  if (getrusage(RUSAGE_THREAD, &ru) == -1) return 0;
+  return ru.ru_minflt + ru.ru_majflt;
+}
+
+static int prof_trace_open(const char *path)
+{
+  if ((prof.trace = fopen(path, "w")) == NULL) return -1;
+  fputs("{\"traceEvents\":[\n", prof.trace);
+  return 0;
+}
+
+static void prof_trace_close(void)
+{
+  if (prof.trace == NULL) return;
+  fputs("{}]}\n", prof.trace); // empty event, no trailing comma
+  fclose(prof.trace);
+  prof.trace = NULL;
+}
+
+static void prof_begin(int phase) { prof.start[phase] = prof_now(); }
+
+static void prof_end(int phase)
+{
+  uint64_t now = prof_now();
+
+  prof.acc[phase] += now - prof.start[phase];
+  if (prof.trace != NULL && phase != PROF_GLYPHS) // glyphs go as a counter
+    fprintf(prof.trace,
+      "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+      "\"ts\":%.3f,\"dur\":%.3f},\n", prof_names[phase],
+      (prof.start[phase] - prof.t0) / 1e3, (now - prof.start[phase]) / 1e3);
+}
+
+static void prof_frame_begin(void)
+{
+  if (prof.t0 == 0) prof.t0 = prof_now();
+  memset(prof.acc, 0, sizeof(prof.acc));
+  prof.draws = 0;
+  prof.faults = prof_faults();
+  prof.frame_start = prof_now();
+}
+
+static void prof_frame_end(void)
+{
+  const double k = 0.1; // weight of the newest frame
+  uint64_t now = prof_now();
+
+  prof.faults = prof_faults() - prof.faults;
+  for (int i = 0; i < PROF_PHASES; i++)
+    prof.avg[i] += k * (prof.acc[i] / 1e6 - prof.avg[i]);
+  prof.avg_frame  += k * ((now - prof.frame_start) / 1e6 - prof.avg_frame);
+  prof.avg_draws  += k * (prof.draws - prof.avg_draws);
+  prof.avg_faults += k * (prof.faults - prof.avg_faults);
+
+  if (prof.trace != NULL)
+    fprintf(prof.trace,
+      "{\"name\":\"frame\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{"
+      "\"draws\":%ld,\"faults\":%ld,\"glyphs_us\":%.3f}},\n",
+      (prof.frame_start - prof.t0) / 1e3, prof.draws, prof.faults,
+      prof.acc[PROF_GLYPHS] / 1e3);
+  prof.frame++;
+}
@@ -0,0 +1,696 @@
+// byte regular expressions, nothing assumed about text or UTF-8: `.` is any
+// byte, `\xHH` a byte value, `[...]` a set of bytes, with `|`, `()`, `*`,
+// `+`, `?` and `{m,n}`. The pattern becomes an NFA (Thompson's) which runs
+// as a DFA built lazily: a DFA state (a set of NFA states) and its
+// transitions are made the first time the data reaches them, so only what
+// the data needs is ever built, and the cache starts over when it's full.
+// A search runs chunks in parallel for the earliest match end, each one
+// starting `reach` bytes (the longest match, RE_REACH when there's no
+// bound) before the chunk so matches across chunks are found. Where the
+// match starts comes from the reversed pattern, run backwards from its end
+// to where the chunk that found it started reading.
+#define RE_CHUNK (4L << 20)
+#define RE_REACH (64L << 10)  // overlap for patterns without a longest match
+#define RE_NODES 512
+#define RE_NFA   8192         // NFA states, with the copies of {m,n}
+#define RE_DFA   1024         // DFA states cached per chunk
+
+enum { RN_SET, RN_CAT, RN_ALT, RN_REP, RN_EMPTY };  // parsed
+enum { RE_BYTES, RE_SPLIT, RE_MATCH };             // NFA
+
+typedef struct renode {
+  int type, a, b;
+  int min, max;              // of RN_REP, max -1 for no bound
+  unsigned char set[32];     // of RN_SET, a bit per byte value
+} renode;
+
+typedef struct restate {
+  int type, out, out1;
+  int node;                  // the set of RE_BYTES
+} restate;
+
+typedef struct regex {
+  renode  node[RE_NODES];
+  int     nnode;
+  restate *s;
+  int     n, cap;
+  int     fwd, rev;          // unanchored and reversed starts
+  long    reach;
+  const char *err;
+} regex;
+
+typedef struct redfa {
+  regex *re;
+  int   *next;   // RE_DFA*256 of state << 1 | accepting, -1 if not known
+  int   *set, *off, *len;    // NFA states of every DFA state
+  char  *acc;
+  int    n, nset, capset;
+  int   *hash;   // 2*RE_DFA, -1 where empty
+  int   *mark, gen, *stack, *tmp;
+  // the start of a search, and the bytes that leave it (-1 after a reset)
+  int    start, nesc, resets;
+  unsigned char esc[256], escb[3];
+} redfa;
+
+typedef struct rejob {
+  job   j;
+  const unsigned char *mem;
+  long  size, start;
+  regex *re;
+  long  best;    // earliest match end, LONG_MAX when there's none
+} rejob;
+
+typedef struct reparse {
+  regex *re;
+  const unsigned char *p, *end;
+} reparse;
+
+static int re_alt(reparse *ps);
+
+static int re_node(regex *re, int type, int a, int b)
+{
+  if (re->nnode == RE_NODES) {
+    re->err = "too long";
+    return -1;
+  }
+  re->node[re->nnode] = (renode){ .type = type, .a = a, .b = b };
+  return re->nnode++;
+}
+
+static void re_range(unsigned char *set, int lo, int hi)
+{
+  for (int c = lo; c <= hi; c++)
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+static int re_hex(int c)
+{
+  return (c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ?
+    c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1);
+}
+
+/* after a backslash: a byte, or -1 for a set added to `set` (\d \w \s) */
+static int re_escape(reparse *ps, unsigned char *set)
+{
+  int c, h, l;
+
+  if (ps->p == ps->end) {
+    ps->re->err = "trailing \\";
+    return -2;
+  }
+  switch (c = *ps->p++) {
+    case 'x':
+      if (ps->end - ps->p < 2 || (h = re_hex(ps->p[0])) == -1 ||
+          (l = re_hex(ps->p[1])) == -1) {
+        ps->re->err = "\\x takes two hex digits";
+        return -2;
+      }
+      ps->p += 2;
+      return h << 4 | l;
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 't': return '\t';
+    case '0': return 0;
+    case 'd': re_range(set, '0', '9'); return -1;
+    case 's': re_range(set, '\t', '\r'); re_range(set, ' ', ' '); return -1;
+    case 'w':
+      re_range(set, '0', '9');
+      re_range(set, 'A', 'Z');
+      re_range(set, 'a', 'z');
+      re_range(set, '_', '_');
+      return -1;
+  }
+  return c;
+}
+
+static int re_class(reparse *ps, unsigned char *set) /* after the [ */
+{
+  int neg = 0, first = 1;
+
+  if (ps->p < ps->end && *ps->p == '^') {
+    neg = 1;
+    ps->p++;
+  }
+  while (ps->p < ps->end && (*ps->p != ']' || first)) {
+    int lo = *ps->p++, hi;
+    first = 0;
+    if (lo == '\\' && (lo = re_escape(ps, set)) < 0) {
+      if (lo == -2) return -1;
+      continue;
+    }
+    hi = lo;
+    if (ps->end - ps->p >= 2 && ps->p[0] == '-' && ps->p[1] != ']') {
+      ps->p++;
+      hi = *ps->p++;
+      if (hi == '\\' && (hi = re_escape(ps, set)) < 0) {
+        if (hi == -1) ps->re->err = "bad range";
+        return -1;
+      }
+      if (hi < lo) {
+        ps->re->err = "bad range";
+        return -1;
+      }
+    }
+    re_range(set, lo, hi);
+  }
+  if (ps->p == ps->end) {
+    ps->re->err = "missing ]";
+    return -1;
+  }
+  ps->p++;
+  if (neg)
+    for (int i = 0; i < 32; i++) set[i] = ~set[i];
+  return 0;
+}
+
+static int re_atom(reparse *ps)
+{
+  regex *re = ps->re;
+  int n, c = *ps->p++;
+
+  switch (c) {
+    case '(':
+      if ((n = re_alt(ps)) == -1) return -1;
+      if (ps->p == ps->end || *ps->p != ')') {
+        re->err = "missing )";
+        return -1;
+      }
+      ps->p++;
+      return n;
+    case ')': re->err = "unmatched )"; return -1;
+    case '*': case '+': case '?': case '{':
+      re->err = "nothing to repeat";
+      return -1;
+  }
+  if ((n = re_node(re, RN_SET, -1, -1)) == -1) return -1;
+  if (c == '.')
+    re_range(re->node[n].set, 0, 255);
+  else if (c == '[')
+    return (re_class(ps, re->node[n].set) == -1 ? -1 : n);
+  else if (c == '\\' && (c = re_escape(ps, re->node[n].set)) < 0)
+    return (c == -2 ? -1 : n);
+  else
+    re_range(re->node[n].set, c, c);
+  return n;
+}
+
+static int re_count(reparse *ps) /* digits of {m,n}, -1 if there are none */
+{
+  int v = -1;
+
+  while (ps->p < ps->end && *ps->p >= '0' && *ps->p <= '9' && v < 10000)
+    v = (v == -1 ? 0 : v*10) + *ps->p++ - '0';
+  return v;
+}
+
+static int re_rep(reparse *ps)
+{
+  int n = re_atom(ps), min, max;
+
+  while (n != -1 && ps->p < ps->end) {
+    switch (*ps->p) {
+      case '*': min = 0; max = -1; break;
+      case '+': min = 1; max = -1; break;
+      case '?': min = 0; max = 1; break;
+      case '{':
+        ps->p++;
+        if ((min = max = re_count(ps)) == -1) goto bad;
+        if (ps->p < ps->end && *ps->p == ',') {
+          ps->p++;
+          max = re_count(ps);
+        }
+        if (ps->p == ps->end || *ps->p != '}' || (max != -1 && max < min) ||
+            max > 1000 || min > 1000)
+          goto bad;
+        break;
+      default:
+        return n;
+    }
+    ps->p++;
+    if ((n = re_node(ps->re, RN_REP, n, -1)) != -1) {
+      ps->re->node[n].min = min;
+      ps->re->node[n].max = max;
+    }
+  }
+  return n;
+bad:
+  ps->re->err = "bad {m,n}";
+  return -1;
+}
+
+static int re_cat(reparse *ps)
+{
+  int a = re_node(ps->re, RN_EMPTY, -1, -1), b;
+
+  while (a != -1 && ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+    if ((b = re_rep(ps)) == -1) return -1;
+    a = (ps->re->node[a].type == RN_EMPTY ? b : re_node(ps->re, RN_CAT, a, b));
+  }
+  return a;
+}
+
+static int re_alt(reparse *ps)
+{
+  int a = re_cat(ps), b;
+
+  while (a != -1 && ps->p < ps->end && *ps->p == '|') {
+    ps->p++;
+    if ((b = re_cat(ps)) == -1) return -1;
+    a = re_node(ps->re, RN_ALT, a, b);
+  }
+  return a;
+}
+
+/* shortest and longest match of a node, -1 for no bound */
+static long re_len(regex *re, int i, int longest)
+{
+  renode *n = &re->node[i];
+  long a, b;
+
+  switch (n->type) {
+    case RN_SET:   return 1;
+    case RN_EMPTY: return 0;
+    case RN_REP:
+      a = re_len(re, n->a, longest);
+      b = (longest ? n->max : n->min);
+      if (a == 0) return 0;
+      return (a == -1 || b == -1 || a * b > (1L << 40) ? -1 : a * b);
+  }
+  a = re_len(re, n->a, longest);
+  b = re_len(re, n->b, longest);
+  if (n->type == RN_CAT) return (a == -1 || b == -1 ? -1 : a + b);
+  if (a == -1 || b == -1) return -1; // longest only, shortest is never -1
+  return (longest ? (a > b ? a : b) : (a < b ? a : b));
+}
+
+static int re_state(regex *re, int type, int out, int out1, int node)
+{
+  if (out < 0 || re->n == RE_NFA) {
+    if (out >= 0) re->err = "too big";
+    return -1;
+  }
+  if (re->n == re->cap) {
+    restate *s = realloc(re->s, sizeof(restate) * (re->cap = re->cap*2 + 64));
+    if (s == NULL) {
+      re->err = "out of memory";
+      return -1;
+    }
+    re->s = s;
+  }
+  re->s[re->n] = (restate){ type, out, out1, node };
+  return re->n++;
+}
+
+/* the states of node i going on to `next`, backwards for the reversed */
+static int re_compile(regex *re, int i, int next, int rev)
+{
+  renode *n = &re->node[i];
+  int a, b, s = next, min = n->min, max = n->max, sub = n->a;
+
+  if (next < 0) return -1;
+  switch (n->type) {
+    case RN_EMPTY: return next;
+    case RN_SET:   return re_state(re, RE_BYTES, next, -1, i);
+    case RN_CAT:
+      return (rev ? re_compile(re, n->b, re_compile(re, n->a, next, rev), rev) :
+        re_compile(re, n->a, re_compile(re, n->b, next, rev), rev));
+    case RN_ALT:
+      a = re_compile(re, n->a, next, rev);
+      b = re_compile(re, n->b, next, rev);
+      return (b < 0 ? -1 : re_state(re, RE_SPLIT, a, b, -1));
+  }
+  if (max == -1) { // a loop back to a split
+    if ((s = re_state(re, RE_SPLIT, next, next, -1)) == -1) return -1;
+    if ((a = re_compile(re, sub, s, rev)) == -1) return -1;
+    re->s[s].out = a;
+  } else {
+    for (int k = 0; k < max - min; k++) // a(a(a)?)? with the next after each
+      if ((s = re_state(re, RE_SPLIT, re_compile(re, sub, s, rev), next, -1))
+          == -1)
+        return -1;
+  }
+  for (int k = 0; k < min; k++)
+    if ((s = re_compile(re, sub, s, rev)) == -1) return -1;
+  return s;
+}
+
+static void re_free(regex *re)
+{
+  if (re == NULL) return;
+  free(re->s);
+  free(re);
+}
+
+/* NULL with *err set when the pattern is no good */
+static regex *re_new(const char *pat, int len, const char **err)
+{
+  regex *re = calloc(1, sizeof(regex));
+  reparse ps = { re, (const unsigned char *)pat,
+    (const unsigned char *)pat + len };
+  int root, any, loop = -1, fwd, skip = -1;
+
+  if (re == NULL) {
+    *err = "out of memory";
+    return NULL;
+  }
+  if ((root = re_alt(&ps)) == -1 || ps.p != ps.end) {
+    *err = (re->err ? re->err : "unmatched )");
+    re_free(re);
+    return NULL;
+  }
+  if (re_len(re, root, 0) == 0) {
+    *err = "matches nothing";
+    re_free(re);
+    return NULL;
+  }
+  re->reach = re_len(re, root, 1);
+  if (re->reach == -1 || re->reach > RE_REACH) re->reach = RE_REACH;
+  // any bytes first, to match anywhere, then the pattern
+  if ((any = re_node(re, RN_SET, -1, -1)) != -1)
+    re_range(re->node[any].set, 0, 255);
+  fwd = re_compile(re, root, re_state(re, RE_MATCH, 0, -1, -1), 0);
+  if (any != -1 && fwd != -1 &&
+      (loop = re_state(re, RE_SPLIT, 0, fwd, -1)) != -1 &&
+      (skip = re_state(re, RE_BYTES, loop, -1, any)) != -1) {
+    re->s[loop].out = skip;
+    re->rev = re_compile(re, root, re_state(re, RE_MATCH, 0, -1, -1), 1);
+  }
+  if (skip == -1 || re->rev == -1) {
+    *err = (re->err ? re->err : "too big");
+    re_free(re);
+    return NULL;
+  }
+  re->fwd = loop;
+  return re;
+}
+
+static void re_reset(redfa *d)
+{
+  d->n = d->nset = 0;
+  d->start = -1;
+  d->resets++;
+  memset(d->next, 0xff, sizeof(int) * RE_DFA * 256);
+  memset(d->hash, 0xff, sizeof(int) * RE_DFA * 2);
+}
+
+static void re_dfa_free(redfa *d)
+{
+  free(d->next);
+  free(d->set);
+  free(d->off);
+  free(d->len);
+  free(d->acc);
+  free(d->hash);
+  free(d->mark);
+  free(d->stack);
+  free(d->tmp);
+}
+
+static int re_dfa(redfa *d, regex *re)
+{
+  *d = (redfa){ .re = re };
+  d->next  = malloc(sizeof(int) * RE_DFA * 256);
+  d->off   = malloc(sizeof(int) * RE_DFA);
+  d->len   = malloc(sizeof(int) * RE_DFA);
+  d->acc   = malloc(RE_DFA);
+  d->hash  = malloc(sizeof(int) * RE_DFA * 2);
+  d->mark  = calloc(re->n, sizeof(int));
+  d->stack = malloc(sizeof(int) * (re->n * 2 + 1));
+  d->tmp   = malloc(sizeof(int) * re->n);
+  if (!d->next || !d->off || !d->len || !d->acc || !d->hash || !d->mark ||
+      !d->stack || !d->tmp) {
+    re_dfa_free(d);
+    return -1;
+  }
+  re_reset(d);
+  return 0;
+}
+
+/* the states without a byte to read that `s` leads to, into d->tmp */
+static void re_closure(redfa *d, int s, int *n)
+{
+  int top = 0;
+
+  d->stack[top++] = s;
+  while (top > 0) {
+    restate *x = &d->re->s[s = d->stack[--top]];
+    if (d->mark[s] == d->gen) continue;
+    d->mark[s] = d->gen;
+    if (x->type == RE_SPLIT) {
+      d->stack[top++] = x->out1;
+      d->stack[top++] = x->out;
+    } else {
+      d->tmp[(*n)++] = s;
+    }
+  }
+}
+
+static int re_intcmp(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+/* the DFA state of the n states in d->tmp, -1 when the cache is full */
+static int re_add(redfa *d, int n)
+{
+  unsigned h = 2166136261u;
+  int i, *set;
+
+  qsort(d->tmp, n, sizeof(int), re_intcmp);
+  for (i = 0; i < n; i++)
+    h = (h ^ d->tmp[i]) * 16777619u;
+  for (i = h % (RE_DFA * 2); d->hash[i] != -1; i = (i + 1) % (RE_DFA * 2)) {
+    int s = d->hash[i];
+    if (d->len[s] == n && memcmp(d->set + d->off[s], d->tmp,
+        sizeof(int) * n) == 0)
+      return s;
+  }
+  if (d->n == RE_DFA) return -1;
+  if (d->nset + n > d->capset) {
+    int cap = (d->nset + n) * 2;
+    if ((set = realloc(d->set, sizeof(int) * cap)) == NULL) return -1;
+    d->set = set;
+    d->capset = cap;
+  }
+  memcpy(d->set + d->nset, d->tmp, sizeof(int) * n);
+  d->off[d->n] = d->nset;
+  d->len[d->n] = n;
+  d->acc[d->n] = 0;
+  for (int k = 0; k < n; k++)
+    d->acc[d->n] |= (d->re->s[d->tmp[k]].type == RE_MATCH);
+  d->nset += n;
+  d->hash[i] = d->n;
+  return d->n++;
+}
+
+/* the state at `start`, << 1 | accepting; -1 if there's no memory */
+static int re_begin(redfa *d, int start)
+{
+  int n = 0, s;
+
+  d->gen++;
+  re_closure(d, start, &n);
+  if ((s = re_add(d, n)) == -1) {
+    re_reset(d);
+    if ((s = re_add(d, n)) == -1) return -1;
+  }
+  return s << 1 | d->acc[s];
+}
+
+/* where state s goes on byte c, made now; the cache may start over */
+static int re_step(redfa *d, int s, unsigned char c)
+{
+  int n = 0, t;
+
+  d->gen++;
+  for (int k = 0; k < d->len[s]; k++) {
+    restate *x = &d->re->s[d->set[d->off[s] + k]];
+    if (x->type == RE_BYTES &&
+        (d->re->node[x->node].set[c >> 3] >> (c & 7) & 1))
+      re_closure(d, x->out, &n);
+  }
+  if ((t = re_add(d, n)) == -1) { // tmp still has the set
+    re_reset(d);
+    if ((t = re_add(d, n)) == -1) return -1;
+    return t << 1 | d->acc[t];
+  }
+  return d->next[s*256 + c] = t << 1 | d->acc[t];
+}
+
+static void re_better(rejob *r, long at)
+{
+  long best = __atomic_load_n(&r->best, __ATOMIC_RELAXED);
+
+  while (at < best &&
+    !__atomic_compare_exchange_n(&r->best, &best, at, 0,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/* the start state of the search and the bytes it doesn't stay on for,
+   -1 if there's no memory */
+static int re_escapes(redfa *d, int start)
+{
+  int s = re_begin(d, start), t, resets = d->resets;
+
+  if (s == -1) return -1;
+  s >>= 1;
+  d->nesc = 0;
+  for (int c = 0; c < 256; c++) {
+    if ((t = d->next[s*256 + c]) == -1 && (t = re_step(d, s, c)) == -1)
+      return -1;
+    if (d->resets != resets) // too many states, no skipping then
+      return ((s = re_begin(d, start)) == -1 ? -1 : s >> 1);
+    if ((d->esc[c] = (t >> 1 != s || (t & 1))) && d->nesc++ < 3)
+      d->escb[d->nesc - 1] = c;
+  }
+  d->start = s;
+  return s;
+}
+
+/* the first byte from i on that leaves the start state */
+static long re_skip(redfa *d, const unsigned char *m, long i, long end)
+{
+  if (d->nesc == 0) return end;
+#ifdef __SSE2__
+  if (d->nesc <= 3) { // a few bytes, as memchr would
+    const __m128i a = _mm_set1_epi8(d->escb[0]),
+      b = _mm_set1_epi8(d->escb[d->nesc > 1]),
+      c = _mm_set1_epi8(d->escb[d->nesc > 2 ? 2 : 0]);
+    for (; i + 16 <= end; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(m + i));
+      int k = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+        _mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b)), _mm_cmpeq_epi8(v, c)));
+      if (k != 0) return i + __builtin_ctz(k);
+    }
+  }
+#endif
+  // lookups that don't wait on each other, unlike the DFA's
+  for (; i + 4 <= end; i += 4)
+    if (d->esc[m[i]] | d->esc[m[i+1]] | d->esc[m[i+2]] | d->esc[m[i+3]])
+      break;
+  for (; i < end && !d->esc[m[i]]; i++)
+    ;
+  return i;
+}
+
+/* the DFA over [i, end) until a transition isn't made yet or accepts,
+   returns where it stopped */
+static long re_run(redfa *d, const unsigned char *m, long i, long end,
+  int *s)
+{
+  const int *next = d->next;
+  int st = *s, t;
+
+  for (; i < end; i++) {
+    if (st == d->start && (i = re_skip(d, m, i, end)) == end) break;
+    if ((t = next[st << 8 | m[i]]) < 0 || (t & 1)) break;
+    st = t >> 1;
+  }
+  *s = st;
+  return i;
+}
+
+/* the earliest match ending in the chunk, from `reach` before it on. A
+   hole is only read until the state stops changing on zeros */
+static void re_chunk(job *j, long chunk)
+{
+  rejob *r = (rejob *)j;
+  const unsigned char *m = r->mem;
+  long off = r->start + chunk*RE_CHUNK, end, i, a, b;
+  redfa d;
+  int s;
+
+  if (off >= __atomic_load_n(&r->best, __ATOMIC_RELAXED)) return;
+  end = (r->size - off < RE_CHUNK ? r->size : off + RE_CHUNK);
+  i = (off - r->start < r->re->reach ? r->start : off - r->re->reach);
+  if (re_dfa(&d, r->re) == -1) return;
+  if ((s = re_escapes(&d, r->re->fwd)) == -1) goto done;
+  for (; i < end; i = b) {
+    if ((a = ext_data(i, end, &b)) == -1) a = b = end;
+    for (; i < a; i++) { // a hole: zeros, as long as they change something
+      int t = d.next[s*256];
+      if (t == -1 && (t = re_step(&d, s, 0)) == -1) goto done;
+      if ((t & 1) && i + 1 > off) {
+        re_better(r, i + 1);
+        goto done;
+      }
+      if (t >> 1 == s && !(t & 1)) break;
+      s = t >> 1;
+    }
+    for (i = a; i < b; ) {
+      long stop = (b - i > (1L << 20) ? i + (1L << 20) : b);
+      int t;
+      if ((i = re_run(&d, m, i, stop, &s)) == stop) {
+        if (i >= __atomic_load_n(&r->best, __ATOMIC_RELAXED) ||
+            job_cancelled(j))
+          goto done;
+        continue;
+      }
+      if ((t = d.next[s*256 + m[i]]) == -1 && (t = re_step(&d, s, m[i])) == -1)
+        goto done;
+      s = t >> 1;
+      if ((t & 1) && ++i > off) {
+        re_better(r, i);
+        goto done;
+      }
+      i += !(t & 1);
+    }
+  }
+done:
+  re_dfa_free(&d);
+}
+
+/* where the chunk the match ending at `end` is of started reading: the
+   match starts there or after */
+static long re_from(rejob *r, long end)
+{
+  long off = r->start + (end - 1 - r->start) / RE_CHUNK * RE_CHUNK;
+
+  return (off - r->start < r->re->reach ? r->start : off - r->re->reach);
+}
+
+/* start of the longest match ending at `end` that starts at `lo` or after,
+   -1 if there's none */
+static long re_start(regex *re, const unsigned char *m, long lo, long end)
+{
+  long start = -1;
+  redfa d;
+  int s;
+
+  if (re_dfa(&d, re) == -1) return -1;
+  if ((s = re_begin(&d, re->rev)) != -1)
+    for (long i = end - 1, t; i >= lo; i--) {
+      s >>= 1;
+      if ((t = d.next[s*256 + m[i]]) == -1 && (t = re_step(&d, s, m[i])) == -1)
+        break;
+      s = t;
+      if (t & 1) start = i;
+      if (d.len[t >> 1] == 0) break; // nothing can match any more
+    }
+  re_dfa_free(&d);
+  return start;
+}
+
+/* NULL if there's nothing to look at; the job owns `re`, `deliver` gets the
+   result */
+static rejob *re_search(regex *re, const char *mem, long size, long start,
+  void (*deliver)(job *))
+{
+  rejob *r;
+
+  if (start < 0 || start >= size) return NULL;
+  if ((r = calloc(1, sizeof(rejob))) == NULL) return NULL;
+  r->j = (job){
+    .name = "regex",
+    .nchunks = (size - start + RE_CHUNK - 1) / RE_CHUNK,
+    .run = re_chunk,
+    .deliver = deliver
+  };
+  r->mem   = (const unsigned char *)mem;
+  r->size  = size;
+  r->start = start;
+  r->re    = re;
+  r->best  = LONG_MAX;
+  return r;
+}
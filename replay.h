@@ -0,0 +1,145 @@
+// input recording and deterministic replay. Events are stored with the
+// frame they were handled in and replayed in that same frame, then timed
+// until the present of the frame that shows their effect.
+//
+// one event per line: frame ms type a b c d [text as hex]
+//   keys:   sym mod repeat 0
+//   mouse:  button state x y (motion: 0 0 x y)
+#define REPLAY_PENDING 256
+
+static struct {
+  FILE *rec, *play;
+  long  frame;
+  int   done;         // replay file ended, quit after the next present
+  uint64_t t0;
+  SDL_Event next;     // read ahead from `play`
+  long  next_frame;
+  // handled, waiting for a present
+  uint64_t pending[REPLAY_PENDING];
+  int   npending;
+  // latencies in ms of every presented event
+  double *lat;
+  long  nlat, caplat;
+} replay = { .next_frame = -1 };
+
+static int replay_isinput(SDL_Event *e)
+{
+  return (e->type == SDL_KEYDOWN || e->type == SDL_KEYUP ||
+    e->type == SDL_MOUSEBUTTONDOWN || e->type == SDL_MOUSEBUTTONUP ||
+    e->type == SDL_MOUSEMOTION || e->type == SDL_TEXTINPUT);
+}
+
+static void replay_record(SDL_Event *e)
+{
+  int a = 0, b = 0, c = 0, d = 0;
+
+  if (!replay_isinput(e)) return;
+  if (replay.t0 == 0) replay.t0 = prof_now();
+  switch (e->type) {
+    case SDL_KEYDOWN: case SDL_KEYUP:
+      a = e->key.keysym.sym; b = e->key.keysym.mod; c = e->key.repeat;
+      break;
+    case SDL_MOUSEBUTTONDOWN: case SDL_MOUSEBUTTONUP:
+      a = e->button.button; b = e->button.state;
+      c = e->button.x; d = e->button.y;
+      break;
+    case SDL_MOUSEMOTION:
+      c = e->motion.x; d = e->motion.y;
+      break;
+  }
+  fprintf(replay.rec, "%ld %.3f %u %d %d %d %d", replay.frame,
+    (prof_now() - replay.t0) / 1e6, e->type, a, b, c, d);
+  if (e->type == SDL_TEXTINPUT) {
+    char hex[sizeof(e->text.text)*2+1];
+    int n = strlen(e->text.text);
+    fmt_hex((unsigned char *)e->text.text, hex, n);
+    hex[n*2] = '\0';
+    fprintf(replay.rec, " %s", hex);
+  }
+  fputc('\n', replay.rec);
+}
+
+/* reads the next event of the file into `replay.next`, -1 at the end */
+static int replay_read(void)
+{
+  char line[256], text[sizeof(replay.next.text.text)*2+1] = "";
+  unsigned int type;
+  double ms;
+  int a, b, c, d;
+  SDL_Event *e = &replay.next;
+
+  while (fgets(line, sizeof(line), replay.play) != NULL) {
+    if (sscanf(line, "%ld %lf %u %d %d %d %d %64s", &replay.next_frame, &ms,
+        &type, &a, &b, &c, &d, text) < 7)
+      continue;
+    memset(e, 0, sizeof(*e));
+    e->type = type;
+    switch (type) {
+      case SDL_KEYDOWN: case SDL_KEYUP:
+        e->key.keysym.sym = a; e->key.keysym.mod = b; e->key.repeat = c;
+        e->key.state = (type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED);
+        break;
+      case SDL_MOUSEBUTTONDOWN: case SDL_MOUSEBUTTONUP:
+        e->button.button = a; e->button.state = b;
+        e->button.x = c; e->button.y = d;
+        break;
+      case SDL_MOUSEMOTION:
+        e->motion.x = c; e->motion.y = d;
+        break;
+      case SDL_TEXTINPUT:
+        fmt_unhex(text, (unsigned char *)e->text.text, strlen(text)/2);
+        break;
+    }
+    return 0;
+  }
+  replay.next_frame = -1;
+  return -1;
+}
+
+/* the events recorded for the current frame, one per call */
+static int replay_next(SDL_Event *e)
+{
+  if (replay.next_frame == -1 && !replay.done && replay_read() == -1)
+    replay.done = 1;
+  if (replay.done || replay.next_frame > replay.frame) return 0;
+  *e = replay.next;
+  replay.next_frame = -1;
+  return 1;
+}
+
+/* an input event was handled at `t`, its effect shows in the next present */
+static void replay_mark(uint64_t t)
+{
+  if (replay.npending < REPLAY_PENDING)
+    replay.pending[replay.npending++] = t;
+}
+
+static void replay_presented(uint64_t t)
+{
+  for (int i = 0; i < replay.npending; i++) {
+    if (replay.nlat == replay.caplat) {
+      double *l = realloc(replay.lat,
+        sizeof(double) * (replay.caplat = replay.caplat*2 + 256));
+      if (l == NULL) break;
+      replay.lat = l;
+    }
+    replay.lat[replay.nlat++] = (t - replay.pending[i]) / 1e6;
+  }
+  replay.npending = 0;
+}
+
+static int replay_cmp(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void replay_report(FILE *out)
+{
+  if (replay.nlat == 0) return;
+  qsort(replay.lat, replay.nlat, sizeof(double), replay_cmp);
+  fprintf(out, "%ld events over %ld frames, input to present: "
+    "p50 %.3fms p99 %.3fms max %.3fms\n", replay.nlat, replay.frame,
+    replay.lat[replay.nlat/2], replay.lat[(long)(replay.nlat*0.99)],
+    replay.lat[replay.nlat-1]);
+}
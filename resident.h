@@ -0,0 +1,141 @@
+// page cache residency of the mapping (mincore): which pages are resident
+// and which came in since the strip was shown, faulted in by the session
+// (or its searches, or read ahead around them). Nothing is kept while it's
+// hidden. What was resident when shown is taken in the background, then
+// while it's shown a slice of the pages is sampled each frame, so a big
+// file costs the same per frame as a small one. Counts are kept per row of
+// the strip it's drawn as.
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#define RES_SLICE (1L << 16)   // pages sampled per frame, at most
+#define RES_EVERY 250000000    // ns between two passes over the file
+
+enum { RES_IN = 1, RES_WAS = 2, RES_CAME = 4 };  // flags of a page
+
+static struct {
+  unsigned char *mem, *page;  // page: RES_ flags
+  long  size, n, psize;       // n pages of psize bytes
+  int   on, ready, base;      // base: RES_WAS is complete
+  long  next, in, came;       // where the pass is, pages in each state
+  uint64_t at;                // when the last pass ended
+  int   rows;                 // of the strip, at most one per page
+  long *rin, *rcame;          // per row
+  long  majflt, minflt;       // of the process when shown
+} res;
+
+static void res_faults(long *maj, long *min)
+{
+  struct rusage ru;
+
+  *maj = *min = 0;
+  if (getrusage(RUSAGE_SELF, &ru) == 0) {
+    *maj = ru.ru_majflt;
+    *min = ru.ru_minflt;
+  }
+}
+
+static long res_first(long row) /* page the row starts at */
+{
+  return (row * res.n + res.rows - 1) / res.rows;
+}
+
+static void res_close(void)
+{
+  free(res.page);
+  free(res.rin);
+  memset(&res, 0, sizeof(res));
+}
+
+/* RES_WAS for what's resident already, a slice of pages a chunk */
+static void res_chunk(job *j, long chunk)
+{
+  unsigned char vec[4096];
+  long end = (res.n - chunk*RES_SLICE < RES_SLICE ? res.n :
+    (chunk + 1) * RES_SLICE);
+
+  for (long p = chunk*RES_SLICE, k; p < end && !job_cancelled(j); p += k) {
+    k = (end - p < sizeof(vec) ? end - p : sizeof(vec));
+    if (mincore(res.mem + p*res.psize, k*res.psize, vec) == -1) return;
+    for (long i = 0; i < k; i++)
+      if (vec[i] & 1) res.page[p + i] |= RES_WAS;
+  }
+}
+
+/* NULL when there's nothing to look at; `deliver` gets the job once what
+   was resident is known (or it was cancelled: then the first pass is) */
+static job *res_open(void *mem, long size, int rows, void (*deliver)(job *))
+{
+  job *j;
+
+  res.psize = sysconf(_SC_PAGESIZE);
+  res.n     = (size + res.psize - 1) / res.psize;
+  res.rows  = (rows < res.n ? rows : res.n);
+  if (size == 0 || res.rows <= 0 ||
+      (res.page = calloc(res.n, 1)) == NULL ||
+      (res.rin = calloc(res.rows * 2, sizeof(long))) == NULL ||
+      (j = calloc(1, sizeof(job))) == NULL) {
+    free(res.page);
+    free(res.rin);
+    res.page = NULL;
+    return NULL;
+  }
+  res.mem   = mem;
+  res.size  = size;
+  res.rcame = res.rin + res.rows;
+  res_faults(&res.majflt, &res.minflt);
+  *j = (job){
+    .name = "cache",
+    .nchunks = (res.n + RES_SLICE - 1) / RES_SLICE,
+    .run = res_chunk,
+    .deliver = deliver
+  };
+  return j;
+}
+
+/* the next slice of a pass, or nothing until it's time for one */
+static void res_tick(uint64_t now)
+{
+  static unsigned char vec[RES_SLICE];
+  long p = res.next, k, row, end;
+
+  if (!res.on || !res.ready || (p == 0 && now - res.at < RES_EVERY))
+    return;
+  k   = (res.n - p < RES_SLICE ? res.n - p : RES_SLICE);
+  row = p * res.rows / res.n;
+  end = res_first(row + 1);
+  if (mincore(res.mem + p*res.psize, k*res.psize, vec) == -1) return;
+  for (long i = 0; i < k; i++, p++) {
+    unsigned char f = res.page[p], in = vec[i] & 1;
+    if (p == end) // rows are a page at least
+      end = res_first(++row + 1);
+    if (in && !(f & RES_WAS)) {
+      if (!res.base)
+        f |= RES_WAS;
+      else if (!(f & RES_CAME)) {
+        f |= RES_CAME;
+        res.came++;
+        res.rcame[row]++;
+      }
+    }
+    if (in != (f & RES_IN)) {
+      res.in += (in ? 1 : -1);
+      res.rin[row] += (in ? 1 : -1);
+    }
+    res.page[p] = (f & ~RES_IN) | in;
+  }
+  if ((res.next = p) == res.n) {
+    res.next = 0;
+    res.at   = now;
+    res.base = 1;
+  }
+}
+
+/* RES_CAME when a page of the row came in, RES_IN when most of it is
+   resident, 0 cold */
+static int res_row(int row)
+{
+  if (res.rcame[row] > 0) return RES_CAME;
+  return (res.rin[row] * 2 >= res_first(row + 1) - res_first(row) ?
+    RES_IN : 0);
+}
@@ -0,0 +1,109 @@
+// byte pattern search run as a background job, first match after `start`.
+// Holes of sparse files (see extents.h) are not read, nor the blocks an
+// index (see ngram.h) tells can't have a match.
+#include <limits.h>
+
+#define FIND_CHUNK (4L << 20)
+
+typedef struct findjob {
+  job   j;
+  const char *mem;
+  long  size, start;
+  unsigned char pat[32];
+  int   len, zeros;  // zeros: the pattern is, so holes can match
+  long  best;  // lowest match so far, LONG_MAX when there's none
+  unsigned char *cand;  // bit i: block i may have a match, NULL for all
+  long  block;
+} findjob;
+
+static void find_better(findjob *f, long at)
+{
+  long best = __atomic_load_n(&f->best, __ATOMIC_RELAXED);
+
+  while (at < best &&
+    !__atomic_compare_exchange_n(&f->best, &best, at, 0,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/* matches starting in [off, end): only the data extents are read, with
+   the bytes around them a match can reach into */
+static void find_range(findjob *f, long off, long end)
+{
+  long reach = (f->size - end < f->len - 1 ? f->size : end + f->len - 1),
+       a, b;
+
+  for (a = off; (a = ext_data(a, reach, &b)) != -1; a = b) {
+    long from = (a - off < f->len - 1 ? off : a - (f->len - 1)),
+         to   = (f->size - b < f->len - 1 ? f->size : b + f->len - 1);
+    char *m;
+    if (from >= __atomic_load_n(&f->best, __ATOMIC_RELAXED)) break;
+    if ((m = memmem(f->mem + from, to - from, f->pat, f->len)) != NULL)
+      find_better(f, m - f->mem);
+  }
+}
+
+static int find_cand(findjob *f, long off) /* the block of off may match */
+{
+  long i = off / f->block;
+  return f->cand[i / 8] >> i % 8 & 1;
+}
+
+static void find_chunk(job *j, long chunk)
+{
+  findjob *f = (findjob *)j;
+  long off = f->start + chunk*FIND_CHUNK, end;
+
+  // an earlier chunk already matched, nothing here can be better
+  if (off >= __atomic_load_n(&f->best, __ATOMIC_RELAXED)) return;
+  end = (f->size - off < FIND_CHUNK ? f->size : off + FIND_CHUNK);
+  if (f->cand == NULL)
+    find_range(f, off, end);
+  else
+    for (long a = off, b; a < end; a = b) { // runs of blocks alike
+      int in = find_cand(f, a);
+      b = (a / f->block + 1) * f->block;
+      while (b < end && find_cand(f, b) == in)
+        b += f->block;
+      if (b > end) b = end;
+      if (in) find_range(f, a, b);
+    }
+  if (!f->zeros) return;
+  for (long h = off, e; h < end; h = e) { // a hole long enough is a match too
+    if (ext_hole(h, &e)) {
+      if (e - h >= f->len) {
+        find_better(f, h);
+        return;
+      }
+    } else if (ext_data(h, end, &e) == -1) {
+      return;
+    }
+  }
+}
+
+/* NULL if there's nothing to look at; `deliver` gets the result */
+static findjob *find_new(const char *mem, long size, long start,
+  const unsigned char *pat, int len, void (*deliver)(job *))
+{
+  findjob *f;
+
+  if (len < 1 || len > sizeof(f->pat) || start < 0 || start >= size)
+    return NULL;
+  if ((f = calloc(1, sizeof(findjob))) == NULL) return NULL;
+  f->j = (job){
+    .name = "find",
+    .nchunks = (size - start + FIND_CHUNK - 1) / FIND_CHUNK,
+    .run = find_chunk,
+    .deliver = deliver
+  };
+  f->mem   = mem;
+  f->size  = size;
+  f->start = start;
+  f->best  = LONG_MAX;
+  f->len   = len;
+  memcpy(f->pat, pat, len);
+  f->zeros = 1;
+  for (int i = 0; i < len; i++)
+    f->zeros &= (pat[i] == 0);
+  return f;
+}
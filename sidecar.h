@@ -0,0 +1,30 @@
+// what hexing keeps about a file lives outside of it, in
+// $XDG_DATA_HOME/hexing (~/.local/share/hexing), in files named by a hash
+// of the real path of the file and what they hold.
+
+/* `<dir>/<hash>.<ext>` into `out`, creating the directory, -1 if there's no
+   place for it */
+static int sidecar_path(const char *real, const char *ext, char *out, int n)
+{
+  const char *data = getenv("XDG_DATA_HOME"), *home = getenv("HOME");
+  char dir[PATH_MAX - 32];
+  uint64_t h = 0xcbf29ce484222325; // fnv-1a
+
+  if (data != NULL && *data != '\0')
+    snprintf(dir, sizeof(dir), "%s/hexing", data);
+  else if (home != NULL)
+    snprintf(dir, sizeof(dir), "%s/.local/share/hexing", home);
+  else
+    return -1;
+  for (char *c = dir + 1; *c; c++) { // mkdir -p
+    if (*c != '/') continue;
+    *c = '\0';
+    mkdir(dir, 0755);
+    *c = '/';
+  }
+  if (mkdir(dir, 0755) == -1 && errno != EEXIST) return -1;
+  for (const char *c = real; *c; c++)
+    h = (h ^ (unsigned char)*c) * 0x100000001b3;
+  snprintf(out, n, "%s/%016llx.%s", dir, (unsigned long long)h, ext);
+  return 0;
+}
@@ -0,0 +1,419 @@
+// strings of the document, like strings(1): runs of at least STR_MIN
+// printable characters in ASCII or UTF-8, and in UTF-16LE/BE (7 bit
+// characters only). A job scans chunks in parallel, 64 bytes at a time as
+// bit masks (printable, zero, UTF-8 lead and continuation bytes; SSE2 where
+// there is) so a run is found from where the masks change rather than byte
+// by byte. A run belongs to the chunk it starts in, which reads on past its
+// end until the run is over. Every string is 8 bytes in the index, sorted
+// by offset.
+#define STR_MIN   4
+#define STR_CHUNK (4L << 20)
+#define STR_FIND  (1L << 16)  // strings per chunk of a filter
+#define STR_TEXT  4096        // what of a string a filter looks at
+
+enum { STR_ASCII = 0, STR_UTF8, STR_UTF16LE, STR_UTF16BE };
+
+static const char *str_encs[] = { "ascii", "utf-8", "utf-16le", "utf-16be" };
+
+typedef uint64_t strhit; // offset << 18 | encoding << 16 | bytes (capped)
+#define STR_OFF(h) ((long)((h) >> 18))
+#define STR_ENC(h) ((int)((h) >> 16) & 3)
+#define STR_LEN(h) ((long)((h) & 0xffff))
+
+typedef struct strlist {
+  strhit *h;
+  long    n, cap;
+} strlist;
+
+typedef struct strjob {
+  job   j;
+  const unsigned char *mem;
+  long  size;
+  strlist *part;  // what each chunk found
+} strjob;
+
+typedef struct strfind {
+  job   j;
+  long  from;      // first string looked at
+  unsigned char text[STR_TEXT];
+  int   len;
+  long  best;      // lowest string matching, LONG_MAX when there's none
+} strfind;
+
+static struct {
+  const unsigned char *mem;
+  long   size;
+  strhit *h;
+  long   n;
+} strs;
+
+static int str_print(unsigned char c)
+{
+  return ((c >= 0x20 && c < 0x7f) || c == '\t');
+}
+
+/* bytes of the valid UTF-8 sequence led by m[i], 0 if there's none */
+static int str_utf8(const unsigned char *m, long size, long i)
+{
+  unsigned char c = m[i], lo = 0x80, hi = 0xBF;
+  int n = (c >= 0xC2 && c <= 0xDF ? 2 : c >= 0xE0 && c <= 0xEF ? 3 :
+    c >= 0xF0 && c <= 0xF4 ? 4 : 0);
+
+  if (n == 0 || i + n > size) return 0;
+  if (c == 0xC2) lo = 0xA0; // no C1 controls, overlong forms or surrogates
+  if (c == 0xE0) lo = 0xA0;
+  if (c == 0xED) hi = 0x9F;
+  if (c == 0xF0) lo = 0x90;
+  if (c == 0xF4) hi = 0x8F;
+  if (m[i+1] < lo || m[i+1] > hi) return 0;
+  for (int k = 2; k < n; k++)
+    if ((m[i+k] & 0xC0) != 0x80) return 0;
+  return n;
+}
+
+/* printable, zero, UTF-8 lead and continuation byte masks of up to 64
+   bytes */
+static void str_masks(const unsigned char *s, long n, uint64_t *p,
+  uint64_t *z, uint64_t *l, uint64_t *c)
+{
+  long i = 0;
+
+  *p = *z = *l = *c = 0;
+#ifdef __SSE2__
+  const __m128i one = _mm_set1_epi8(1), space = _mm_set1_epi8(0x20),
+                tab = _mm_set1_epi8('\t'), nul = _mm_setzero_si128(),
+                c1 = _mm_set1_epi8((char)0xC1), f5 = _mm_set1_epi8((char)0xF5),
+                c0 = _mm_set1_epi8((char)0xC0);
+  for (; n == 64 && i < 64; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    // 0x20-0x7e is what stays above 0x20 (signed) after adding one
+    __m128i pr = _mm_or_si128(_mm_cmpgt_epi8(_mm_add_epi8(v, one), space),
+      _mm_cmpeq_epi8(v, tab));
+    // signed too: leads are 0xC2-0xF4, continuations 0x80-0xBF
+    __m128i ld = _mm_and_si128(_mm_cmpgt_epi8(v, c1), _mm_cmplt_epi8(v, f5));
+    *p |= (uint64_t)(unsigned)_mm_movemask_epi8(pr) << i;
+    *z |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nul)) << i;
+    *l |= (uint64_t)(unsigned)_mm_movemask_epi8(ld) << i;
+    *c |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmplt_epi8(v, c0)) << i;
+  }
+#endif
+  for (; i < n; i++) {
+    *p |= (uint64_t)str_print(s[i]) << i;
+    *z |= (uint64_t)(s[i] == 0) << i;
+    *l |= (uint64_t)(s[i] >= 0xC2 && s[i] <= 0xF4) << i;
+    *c |= (uint64_t)((s[i] & 0xC0) == 0x80) << i;
+  }
+}
+
+static int str_push(strlist *l, strhit h)
+{
+  if (l->n == l->cap) {
+    strhit *n = realloc(l->h, sizeof(strhit) * (l->cap = l->cap*2 + 256));
+    if (n == NULL) return -1;
+    l->h = n;
+  }
+  l->h[l->n++] = h;
+  return 0;
+}
+
+/* a run of [start, end) is over, kept when it's long enough */
+static void str_emit(strjob *s, strlist *l, long start, long end, int k,
+  int enc)
+{
+  long len = end - start, chars = len / k;
+
+  if (chars < STR_MIN) return;
+  if (k == 1) { // characters, not bytes
+    const unsigned char *m = s->mem;
+    chars = 0;
+    for (long i = start; i < end; i++) {
+      chars += ((m[i] & 0xC0) != 0x80);
+      enc |= (m[i] >> 7); // STR_UTF8
+    }
+  }
+  if (chars >= STR_MIN)
+    str_push(l, (strhit)start << 18 | (strhit)enc << 16 |
+      (len > 0xffff ? 0xffff : len));
+}
+
+/* the runs of one mask of units `k` bytes apart: a run starts where a unit
+   has none before it and ends where the one after it is missing */
+static void str_runs(strjob *s, strlist *l, uint64_t cur, uint64_t *prev,
+  int k, int enc, long p, long *open, long from, long to)
+{
+  uint64_t before = cur << k | *prev >> (64 - k),
+           starts = cur & ~before, ends = before & ~cur;
+
+  if (k == 1) { // only the runs of 4 bytes or more: most are 1 or 2
+    uint64_t on = (open[0] != -1);
+    starts &= (cur & cur >> 1 & cur >> 2 & cur >> 3) | 7ULL << 61;
+    // a carry through each run from its start lands just past its end
+    ends = ((cur + (starts | (cur & on))) & ~cur) | (~cur & on);
+  }
+  for (uint64_t e = starts | ends; e != 0; e &= e - 1) {
+    int  i = __builtin_ctzll(e);
+    long at = p + i, *o = &open[at & (k - 1)];
+    if (ends >> i & 1) {
+      if (*o >= from) str_emit(s, l, *o, at, k, enc);
+      *o = -1;
+    } else if (at < to) {
+      *o = at;
+    }
+  }
+  *prev = cur;
+}
+
+/* the strings starting in [from, to) */
+static void str_scan(strjob *s, strlist *l, long from, long to)
+{
+  const unsigned char *m = s->mem;
+  long size = s->size, open[5] = { -1, -1, -1, -1, -1 }; // text, le, be
+  uint64_t pt = 0, pu = 0, pv = 0, cont = 0;
+
+  if (from > 0) { // what goes on from before: marked, but not ours
+    for (int k = 1; k <= 4 && k <= from; k++) {
+      int n = str_utf8(m, size, from - k);
+      if (n >= k) {
+        pt = 1ULL << 63;
+        cont = (1ULL << (n - k)) - 1;
+        break;
+      }
+    }
+    if (str_print(m[from-1])) pt = 1ULL << 63;
+    for (int k = 1; k <= 2 && k <= from; k++) {
+      long i = from - k;
+      pu |= (uint64_t)(str_print(m[i]) && m[i+1] == 0) << (64 - k);
+      pv |= (uint64_t)(m[i] == 0 && str_print(m[i+1])) << (64 - k);
+    }
+    if (pt) open[0] = from - 1;
+    for (int k = 1; k <= 2; k++) {
+      if (pu >> (64 - k) & 1) open[1 + ((from - k) & 1)] = from - 1;
+      if (pv >> (64 - k) & 1) open[3 + ((from - k) & 1)] = from - 1;
+    }
+  }
+  for (long p = from; p < to || open[0] != -1 || open[1] != -1 ||
+      open[2] != -1 || open[3] != -1 || open[4] != -1; p += 64) {
+    long n = (size - p < 64 ? size - p : 64);
+    uint64_t P = 0, Z = 0, L = 0, C = 0, T, U, V, marks = cont,
+             nz = 0, np = 0, nc = 0;
+    if (n > 0) str_masks(m + p, n, &P, &Z, &L, &C);
+    if (p + 64 < size) {
+      nz = (m[p+64] == 0);
+      np = str_print(m[p+64]);
+      nc = ((m[p+64] & 0xC0) == 0x80);
+    }
+    cont = 0;
+    // UTF-8 sequences, from the leads followed by a continuation byte
+    for (uint64_t h = L & (C >> 1 | nc << 63) & ~marks; h != 0; h &= h - 1) {
+      int i = __builtin_ctzll(h), k;
+      if ((marks >> i & 1) || (k = str_utf8(m, size, p + i)) == 0) continue;
+      if (i + k <= 64) {
+        marks |= ((1ULL << k) - 1) << i;
+      } else {
+        marks |= ~0ULL << i;
+        cont = (1ULL << (i + k - 64)) - 1;
+      }
+    }
+    T = P | marks;
+    U = P & (Z >> 1 | nz << 63); // 'A' 0
+    V = Z & (P >> 1 | np << 63); // 0 'A'
+    str_runs(s, l, T, &pt, 1, STR_ASCII, p, open, from, to);
+    str_runs(s, l, U, &pu, 2, STR_UTF16LE, p, open + 1, from, to);
+    str_runs(s, l, V, &pv, 2, STR_UTF16BE, p, open + 3, from, to);
+  }
+}
+
+static int str_cmp(const void *a, const void *b)
+{
+  strhit x = *(const strhit *)a, y = *(const strhit *)b;
+  return (x > y) - (x < y);
+}
+
+/* only the data extents, the holes have no strings */
+static void str_chunk(job *j, long chunk)
+{
+  strjob *s = (strjob *)j;
+  strlist *l = &s->part[chunk];
+  long off = chunk*STR_CHUNK, end, a, b;
+
+  end = (s->size - off < STR_CHUNK ? s->size : off + STR_CHUNK);
+  for (a = off; (a = ext_data(a, end, &b)) != -1; a = b)
+    str_scan(s, l, a, b);
+  qsort(l->h, l->n, sizeof(strhit), str_cmp);
+}
+
+static void str_worker(long i, void *arg) /* for pool_run */
+{
+  str_chunk(arg, i);
+}
+
+/* NULL if there's nothing to look at; `deliver` gets the result */
+static strjob *str_new(const char *mem, long size, void (*deliver)(job *))
+{
+  strjob *s;
+
+  if (mem == NULL || size <= 0) return NULL;
+  if ((s = calloc(1, sizeof(strjob))) == NULL) return NULL;
+  s->j = (job){
+    .name = "strings",
+    .nchunks = (size + STR_CHUNK - 1) / STR_CHUNK,
+    .run = str_chunk,
+    .deliver = deliver
+  };
+  s->mem  = (const unsigned char *)mem;
+  s->size = size;
+  if ((s->part = calloc(s->j.nchunks, sizeof(strlist))) == NULL) {
+    free(s);
+    return NULL;
+  }
+  return s;
+}
+
+static void str_free(strjob *s)
+{
+  if (s->part != NULL)
+    for (long c = 0; c < s->j.nchunks; c++)
+      free(s->part[c].h);
+  free(s->part);
+  free(s);
+}
+
+/* the chunks of a finished job become the index; text that reads as both
+   UTF-16LE and BE one byte apart is kept once, the longer */
+static int str_take(strjob *s)
+{
+  strhit *h;
+  long n = 0;
+
+  for (long c = 0; c < s->j.nchunks; c++)
+    n += s->part[c].n;
+  if ((h = malloc(sizeof(strhit) * (n ? n : 1))) == NULL) return -1;
+  n = 0;
+  for (long c = 0; c < s->j.nchunks; c++) {
+    for (long i = 0; i < s->part[c].n; i++) {
+      strhit x = s->part[c].h[i], *y = (n > 0 ? &h[n-1] : NULL);
+      if (y != NULL && STR_ENC(x) >= STR_UTF16LE &&
+          STR_ENC(*y) >= STR_UTF16LE && STR_ENC(x) != STR_ENC(*y) &&
+          STR_OFF(x) == STR_OFF(*y) + 1) {
+        if (STR_LEN(x) > STR_LEN(*y) ||
+            (STR_LEN(x) == STR_LEN(*y) && STR_ENC(x) == STR_UTF16LE))
+          *y = x;
+        continue;
+      }
+      h[n++] = x;
+    }
+    free(s->part[c].h);
+  }
+  free(s->part);
+  s->part = NULL;
+  free(strs.h);
+  strs.mem  = s->mem;
+  strs.size = s->size;
+  strs.h    = h;
+  strs.n    = n;
+  return 0;
+}
+
+static void str_drop(void) /* the index, of bytes that changed since */
+{
+  free(strs.h);
+  strs.h = NULL;
+  strs.n = 0;
+}
+
+static long str_first(long off) /* index of the first string after `off` */
+{
+  long lo = 0, hi = strs.n;
+
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    if (STR_OFF(strs.h[mid]) <= off) lo = mid + 1; else hi = mid;
+  }
+  return lo;
+}
+
+/* index of the string `off` is in, -1 if it's in none */
+static long str_at(long off)
+{
+  long i = str_first(off) - 1;
+
+  if (i >= 0 && off < STR_OFF(strs.h[i]) + STR_LEN(strs.h[i])) return i;
+  return -1;
+}
+
+/* index of the next string after `off`, or of the one before the string
+   it's in; -1 when there's none */
+static long str_next(long off, int dir)
+{
+  long i = str_first(off);
+
+  if (dir > 0) return (i < strs.n ? i : -1);
+  if (--i >= 0 && off < STR_OFF(strs.h[i]) + STR_LEN(strs.h[i])) i--;
+  return i;
+}
+
+/* the characters of string i into `t` (UTF-8 as it is), returns how many
+   bytes that is */
+static long str_text(long i, unsigned char *t, long n)
+{
+  strhit h = strs.h[i];
+  const unsigned char *m = strs.mem + STR_OFF(h);
+  long len = STR_LEN(h), k = 0;
+
+  if (STR_ENC(h) < STR_UTF16LE) {
+    k = (len < n ? len : n);
+    memcpy(t, m, k);
+    return k;
+  }
+  for (long j = (STR_ENC(h) == STR_UTF16BE); j < len && k < n; j += 2)
+    t[k++] = m[j];
+  return k;
+}
+
+static void str_better(strfind *f, long at)
+{
+  long best = __atomic_load_n(&f->best, __ATOMIC_RELAXED);
+
+  while (at < best &&
+    !__atomic_compare_exchange_n(&f->best, &best, at, 0,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+static void str_find_chunk(job *j, long chunk)
+{
+  strfind *f = (strfind *)j;
+  unsigned char t[STR_TEXT];
+  long i = f->from + chunk*STR_FIND,
+       end = (strs.n - i < STR_FIND ? strs.n : i + STR_FIND);
+
+  for (; i < end && i < __atomic_load_n(&f->best, __ATOMIC_RELAXED); i++) {
+    long n = str_text(i, t, sizeof(t));
+    if (memmem(t, n, f->text, f->len) != NULL) {
+      str_better(f, i);
+      return;
+    }
+  }
+}
+
+/* the first string from index `from` on with `text` in it, NULL if there's
+   nothing to look at */
+static strfind *str_find_new(long from, const char *text, int len,
+  void (*deliver)(job *))
+{
+  strfind *f;
+
+  if (len < 1 || len > STR_TEXT || from < 0 || from >= strs.n) return NULL;
+  if ((f = calloc(1, sizeof(strfind))) == NULL) return NULL;
+  f->j = (job){
+    .name = "strings",
+    .nchunks = (strs.n - from + STR_FIND - 1) / STR_FIND,
+    .run = str_find_chunk,
+    .deliver = deliver
+  };
+  f->from = from;
+  f->best = LONG_MAX;
+  f->len  = len;
+  memcpy(f->text, text, len);
+  return f;
+}
@@ -0,0 +1,363 @@
+// structure templates: headers and records of a few formats declared as
+// field tables, overlaid on the view. Nothing is decoded up front besides
+// the few header fields that say where the records are; records are only
+// decoded where they meet the window. Back to back records (chunks, packets)
+// are walked lazily from the start, a bounded amount per frame, keeping a
+// checkpoint every TMPL_STEP records so any record is a short walk away.
+#define TMPL_STEP   256
+#define TMPL_BUDGET 512    // records walked per frame
+#define TMPL_FIELDS 32
+#define TMPL_MAX    8      // regions of a file
+
+#define TMPL_VAR(k) (-1 - (k)) // size is the value of field k
+#define TMPL_REST   (-100)     // up to the size of the region
+
+typedef struct tfield {
+  const char *name;
+  int size;
+} tfield;
+
+typedef struct ttype {
+  const char *name;
+  const tfield *f;
+  const char *sig;   // back to back records end where it's missing
+  int siglen;
+} ttype;
+
+enum { TMPL_ONE = 0, TMPL_ARRAY, TMPL_CHAIN };
+
+typedef struct tregion {
+  const ttype *t;
+  int  kind, be;
+  long base, count, stride;  // one: stride is the size if the type has a rest
+  // chains
+  long *ck;          // offset of every TMPL_STEP-th record
+  long nck, cap;
+  long next, nrec;   // where the walk is, records behind it
+  int  done;
+} tregion;
+
+static const tfield elf64_ehdr[] = {
+  {"e_ident", 16}, {"e_type", 2}, {"e_machine", 2}, {"e_version", 4},
+  {"e_entry", 8}, {"e_phoff", 8}, {"e_shoff", 8}, {"e_flags", 4},
+  {"e_ehsize", 2}, {"e_phentsize", 2}, {"e_phnum", 2}, {"e_shentsize", 2},
+  {"e_shnum", 2}, {"e_shstrndx", 2}, {NULL}
+};
+static const tfield elf32_ehdr[] = {
+  {"e_ident", 16}, {"e_type", 2}, {"e_machine", 2}, {"e_version", 4},
+  {"e_entry", 4}, {"e_phoff", 4}, {"e_shoff", 4}, {"e_flags", 4},
+  {"e_ehsize", 2}, {"e_phentsize", 2}, {"e_phnum", 2}, {"e_shentsize", 2},
+  {"e_shnum", 2}, {"e_shstrndx", 2}, {NULL}
+};
+static const tfield elf64_phdr[] = {
+  {"p_type", 4}, {"p_flags", 4}, {"p_offset", 8}, {"p_vaddr", 8},
+  {"p_paddr", 8}, {"p_filesz", 8}, {"p_memsz", 8}, {"p_align", 8}, {NULL}
+};
+static const tfield elf32_phdr[] = {
+  {"p_type", 4}, {"p_offset", 4}, {"p_vaddr", 4}, {"p_paddr", 4},
+  {"p_filesz", 4}, {"p_memsz", 4}, {"p_flags", 4}, {"p_align", 4}, {NULL}
+};
+static const tfield elf64_shdr[] = {
+  {"sh_name", 4}, {"sh_type", 4}, {"sh_flags", 8}, {"sh_addr", 8},
+  {"sh_offset", 8}, {"sh_size", 8}, {"sh_link", 4}, {"sh_info", 4},
+  {"sh_addralign", 8}, {"sh_entsize", 8}, {NULL}
+};
+static const tfield elf32_shdr[] = {
+  {"sh_name", 4}, {"sh_type", 4}, {"sh_flags", 4}, {"sh_addr", 4},
+  {"sh_offset", 4}, {"sh_size", 4}, {"sh_link", 4}, {"sh_info", 4},
+  {"sh_addralign", 4}, {"sh_entsize", 4}, {NULL}
+};
+static const tfield pe_dos[] = {
+  {"e_magic", 2}, {"e_cblp", 2}, {"e_cp", 2}, {"e_crlc", 2},
+  {"e_cparhdr", 2}, {"e_minalloc", 2}, {"e_maxalloc", 2}, {"e_ss", 2},
+  {"e_sp", 2}, {"e_csum", 2}, {"e_ip", 2}, {"e_cs", 2}, {"e_lfarlc", 2},
+  {"e_ovno", 2}, {"e_res", 8}, {"e_oemid", 2}, {"e_oeminfo", 2},
+  {"e_res2", 20}, {"e_lfanew", 4}, {NULL}
+};
+static const tfield pe_nt[] = {
+  {"Signature", 4}, {"Machine", 2}, {"NumberOfSections", 2},
+  {"TimeDateStamp", 4}, {"PointerToSymbolTable", 4},
+  {"NumberOfSymbols", 4}, {"SizeOfOptionalHeader", 2},
+  {"Characteristics", 2}, {NULL}
+};
+static const tfield pe_opt[] = {
+  {"Magic", 2}, {"MajorLinkerVersion", 1}, {"MinorLinkerVersion", 1},
+  {"SizeOfCode", 4}, {"SizeOfInitializedData", 4},
+  {"SizeOfUninitializedData", 4}, {"AddressOfEntryPoint", 4},
+  {"BaseOfCode", 4}, {"rest", TMPL_REST}, {NULL}
+};
+static const tfield pe_section[] = {
+  {"Name", 8}, {"VirtualSize", 4}, {"VirtualAddress", 4},
+  {"SizeOfRawData", 4}, {"PointerToRawData", 4},
+  {"PointerToRelocations", 4}, {"PointerToLinenumbers", 4},
+  {"NumberOfRelocations", 2}, {"NumberOfLinenumbers", 2},
+  {"Characteristics", 4}, {NULL}
+};
+static const tfield png_sig[] = { {"signature", 8}, {NULL} };
+static const tfield png_chunk[] = {
+  {"length", 4}, {"type", 4}, {"data", TMPL_VAR(0)}, {"crc", 4}, {NULL}
+};
+static const tfield pcap_hdr[] = {
+  {"magic", 4}, {"version_major", 2}, {"version_minor", 2},
+  {"thiszone", 4}, {"sigfigs", 4}, {"snaplen", 4}, {"network", 4}, {NULL}
+};
+static const tfield pcap_rec[] = {
+  {"ts_sec", 4}, {"ts_usec", 4}, {"incl_len", 4}, {"orig_len", 4},
+  {"data", TMPL_VAR(2)}, {NULL}
+};
+static const tfield zip_local[] = {
+  {"signature", 4}, {"version", 2}, {"flags", 2}, {"method", 2},
+  {"time", 2}, {"date", 2}, {"crc32", 4}, {"csize", 4}, {"usize", 4},
+  {"namelen", 2}, {"extralen", 2}, {"name", TMPL_VAR(9)},
+  {"extra", TMPL_VAR(10)}, {"data", TMPL_VAR(7)}, {NULL}
+};
+
+static const ttype
+  t_elf64_ehdr = {"ehdr", elf64_ehdr}, t_elf32_ehdr = {"ehdr", elf32_ehdr},
+  t_elf64_phdr = {"phdr", elf64_phdr}, t_elf32_phdr = {"phdr", elf32_phdr},
+  t_elf64_shdr = {"shdr", elf64_shdr}, t_elf32_shdr = {"shdr", elf32_shdr},
+  t_pe_dos = {"dos", pe_dos}, t_pe_nt = {"nt", pe_nt},
+  t_pe_opt = {"optional", pe_opt}, t_pe_section = {"section", pe_section},
+  t_png_sig = {"png", png_sig}, t_png_chunk = {"chunk", png_chunk},
+  t_pcap_hdr = {"pcap", pcap_hdr}, t_pcap_rec = {"packet", pcap_rec},
+  t_zip_local = {"local", zip_local, "PK\x03\x04", 4};
+
+static struct {
+  const unsigned char *mem;
+  long size;
+  tregion r[TMPL_MAX];
+  int  n;
+  unsigned int color;  // of every other field
+  span vis[HL_VISMAX];
+  long left;           // of the frame's budget
+} tmpl;
+
+static unsigned long tmpl_get(long off, int size, int be)
+{
+  unsigned long v = 0;
+
+  if (size > 8 || off < 0 || off + size > tmpl.size) return 0;
+  for (int i = 0; i < size; i++)
+    v |= (unsigned long)tmpl.mem[off + i] << 8*(be ? size-1-i : i);
+  return v;
+}
+
+/* field offsets of the record at `off` into fo (fo[n] is its end), the
+   amount of fields or -1 when it doesn't fit in the file */
+static int tmpl_fields(tregion *r, long off, long *fo)
+{
+  const tfield *f = r->t->f;
+  int n;
+
+  fo[0] = off;
+  for (n = 0; f[n].name != NULL && n < TMPL_FIELDS; n++) {
+    long size = f[n].size;
+    if (size == TMPL_REST)
+      size = r->base + r->stride - fo[n];
+    else if (size < 0)
+      size = tmpl_get(fo[-1 - size], f[-1 - size].size, r->be);
+    if (size < 0 || fo[n] + size > tmpl.size) return -1;
+    fo[n+1] = fo[n] + size;
+  }
+  if (r->t->sig != NULL && (off + r->t->siglen > tmpl.size ||
+      memcmp(tmpl.mem + off, r->t->sig, r->t->siglen) != 0))
+    return -1;
+  return n;
+}
+
+static void tmpl_region(const ttype *t, int kind, int be, long base,
+  long count, long stride)
+{
+  if (tmpl.n == TMPL_MAX || base < 0 || base >= tmpl.size) return;
+  tmpl.r[tmpl.n++] = (tregion){ .t = t, .kind = kind, .be = be,
+    .base = base, .count = count, .stride = stride, .next = base };
+}
+
+/* a new frame: chains may be walked TMPL_BUDGET records further */
+static void tmpl_tick(void)
+{
+  tmpl.left = TMPL_BUDGET;
+}
+
+/* walks a chain on until it passes `upto`, as far as the frame allows */
+static void tmpl_walk(tregion *r, long upto)
+{
+  long fo[TMPL_FIELDS+1];
+
+  for (; !r->done && r->next <= upto && tmpl.left > 0; tmpl.left--) {
+    int n = tmpl_fields(r, r->next, fo);
+    if (n == -1 || fo[n] == r->next) {
+      r->done = 1;
+      break;
+    }
+    if (r->nrec % TMPL_STEP == 0) {
+      if (r->nck == r->cap) {
+        long *ck = realloc(r->ck, sizeof(long) * (r->cap = r->cap*2 + 64));
+        if (ck == NULL) { r->done = 1; break; }
+        r->ck = ck;
+      }
+      r->ck[r->nck++] = r->next;
+    }
+    r->next = fo[n];
+    r->nrec++;
+    if (r->next >= tmpl.size) r->done = 1;
+  }
+}
+
+/* the first record ending after `off`: its start and index, -1 if none
+   (or not walked to yet) */
+static long tmpl_first(tregion *r, long off, long *idx)
+{
+  long fo[TMPL_FIELDS+1], rec, lo = 0, hi;
+  int n;
+
+  if (off < r->base) off = r->base;
+  switch (r->kind) {
+    case TMPL_ONE:
+      *idx = 0;
+      n = tmpl_fields(r, r->base, fo);
+      return (n > 0 && off < fo[n] ? r->base : -1);
+    case TMPL_ARRAY:
+      *idx = (off - r->base) / r->stride;
+      return (*idx < r->count ? r->base + *idx * r->stride : -1);
+  }
+  tmpl_walk(r, off);
+  if (off >= r->next || r->nck == 0) return -1;
+  hi = r->nck;
+  while (hi - lo > 1) { // last checkpoint at or before off
+    long mid = (lo + hi) / 2;
+    if (r->ck[mid] <= off) lo = mid; else hi = mid;
+  }
+  rec = r->ck[lo];
+  *idx = lo * TMPL_STEP;
+  while ((n = tmpl_fields(r, rec, fo)) != -1 && fo[n] <= off) {
+    rec = fo[n];
+    (*idx)++;
+  }
+  return (n == -1 ? -1 : rec);
+}
+
+/* the record after `rec`, -1 at the end */
+static long tmpl_following(tregion *r, long rec, long idx)
+{
+  long fo[TMPL_FIELDS+1];
+  int n;
+
+  switch (r->kind) {
+    case TMPL_ONE:
+      return -1;
+    case TMPL_ARRAY:
+      return (idx + 1 < r->count ? rec + r->stride : -1);
+  }
+  if ((n = tmpl_fields(r, rec, fo)) == -1) return -1;
+  tmpl_walk(r, fo[n]);
+  return (fo[n] < r->next ? fo[n] : -1);
+}
+
+/* spans of every other field of the records in the window */
+static int tmpl_window(long off, long len, span **out, int max)
+{
+  int k = 0;
+
+  for (int i = 0; i < tmpl.n; i++) {
+    tregion *r = &tmpl.r[i];
+    long fo[TMPL_FIELDS+1], idx, rec = tmpl_first(r, off, &idx);
+    for (; rec != -1 && rec < off + len;
+        rec = tmpl_following(r, rec, idx++)) {
+      int n = tmpl_fields(r, rec, fo);
+      for (int f = 1; f < n && k < max; f += 2) {
+        if (fo[f+1] <= off || fo[f] >= off + len || fo[f] == fo[f+1])
+          continue;
+        tmpl.vis[k] = (span){ fo[f], fo[f+1], fo[f+1], tmpl.color, HL_TMPL };
+        out[k] = &tmpl.vis[k];
+        k++;
+      }
+    }
+  }
+  return k;
+}
+
+/* `type[index].field value` of what's at `off`, 0 if there's nothing */
+static int tmpl_at(long off, char *d, int size)
+{
+  for (int i = 0; i < tmpl.n; i++) {
+    tregion *r = &tmpl.r[i];
+    long fo[TMPL_FIELDS+1], idx, rec = tmpl_first(r, off, &idx);
+    int n;
+    if (rec == -1 || rec > off || (n = tmpl_fields(r, rec, fo)) == -1)
+      continue;
+    for (int f = 0; f < n; f++) {
+      const tfield *tf = &r->t->f[f];
+      int len = fo[f+1] - fo[f];
+      if (off < fo[f] || off >= fo[f+1]) continue;
+      if (r->kind == TMPL_ONE)
+        len = snprintf(d, size, "%s.%s", r->t->name, tf->name);
+      else
+        len = snprintf(d, size, "%s[%ld].%s", r->t->name, idx, tf->name);
+      n = fo[f+1] - fo[f];
+      if ((n == 1 || n == 2 || n == 4 || n == 8) && len < size)
+        snprintf(d + len, size - len, " %lX", tmpl_get(fo[f], n, r->be));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* where the records are, from the headers of the formats we know */
+static void tmpl_open(const char *mem, long size, const char *suffix,
+  unsigned int color)
+{
+  const unsigned char *m = (const unsigned char *)mem;
+
+  tmpl.mem   = m;
+  tmpl.size  = size;
+  tmpl.color = color;
+  tmpl.n     = 0;
+  tmpl.left  = TMPL_BUDGET;
+  if (suffix == NULL) return;
+
+  if (strcmp(suffix, "elf") == 0 && size >= 52) {
+    int is64 = (m[4] == 2), be = (m[5] == 2);
+    if (is64 && size < 64) return;
+    tmpl_region(is64 ? &t_elf64_ehdr : &t_elf32_ehdr, TMPL_ONE, be, 0, 1, 0);
+    if (is64) {
+      tmpl_region(&t_elf64_phdr, TMPL_ARRAY, be, tmpl_get(32, 8, be),
+        tmpl_get(56, 2, be), tmpl_get(54, 2, be));
+      tmpl_region(&t_elf64_shdr, TMPL_ARRAY, be, tmpl_get(40, 8, be),
+        tmpl_get(60, 2, be), tmpl_get(58, 2, be));
+    } else {
+      tmpl_region(&t_elf32_phdr, TMPL_ARRAY, be, tmpl_get(28, 4, be),
+        tmpl_get(44, 2, be), tmpl_get(42, 2, be));
+      tmpl_region(&t_elf32_shdr, TMPL_ARRAY, be, tmpl_get(32, 4, be),
+        tmpl_get(48, 2, be), tmpl_get(46, 2, be));
+    }
+  } else if (strcmp(suffix, "exe") == 0 && size >= 64) {
+    long nt = tmpl_get(0x3c, 4, 0), opt = nt + 24,
+         optsize = tmpl_get(nt + 20, 2, 0);
+    tmpl_region(&t_pe_dos, TMPL_ONE, 0, 0, 1, 0);
+    if (nt + 24 > size || memcmp(m + nt, "PE\0\0", 4) != 0) return;
+    tmpl_region(&t_pe_nt, TMPL_ONE, 0, nt, 1, 0);
+    if (optsize >= 24)
+      tmpl_region(&t_pe_opt, TMPL_ONE, 0, opt, 1, optsize);
+    tmpl_region(&t_pe_section, TMPL_ARRAY, 0, opt + optsize,
+      tmpl_get(nt + 6, 2, 0), 40);
+  } else if (strcmp(suffix, "png") == 0) {
+    tmpl_region(&t_png_sig, TMPL_ONE, 1, 0, 1, 0);
+    tmpl_region(&t_png_chunk, TMPL_CHAIN, 1, 8, 0, 0);
+  } else if (strcmp(suffix, "pcap") == 0 && size >= 24) {
+    int be = (m[0] == 0xa1); // a1b2c3d4 or a1b23c4d as written
+    tmpl_region(&t_pcap_hdr, TMPL_ONE, be, 0, 1, 0);
+    tmpl_region(&t_pcap_rec, TMPL_CHAIN, be, 24, 0, 0);
+  } else if (strcmp(suffix, "zip") == 0) {
+    // local headers only, streamed entries (sizes after the data) end it
+    tmpl_region(&t_zip_local, TMPL_CHAIN, 0, 0, 0, 0);
+  }
+
+  // arrays that don't fit or make no sense are dropped
+  for (int i = 0; i < tmpl.n; i++) {
+    tregion *r = &tmpl.r[i];
+    if (r->kind == TMPL_ARRAY && (r->stride <= 0 || r->count <= 0 ||
+        r->base + r->count * r->stride > size))
+      memmove(r, r + 1, sizeof(tregion) * (--tmpl.n - i--));
+  }
+}
@@ -0,0 +1,228 @@
+// session edits exported as UPS patches and a streaming apply for them.
+// Only overwrites exist so source and target always have the same size.
+#define UPS_WINDOW (1 << 20)
+
+enum {
+  UPS_OK = 0,
+  UPS_ALREADY,
+  UPS_BADPATCH,
+  UPS_BADSOURCE,
+  UPS_SIZE,
+  UPS_IO
+};
+
+static const char *ups_errors[] = {
+  "ok", "already applied", "corrupt patch", "source checksum mismatch",
+  "size changing patches are not supported", "i/o error"
+};
+
+typedef struct upshunk {
+  long off, len;
+  const unsigned char *xor;
+} upshunk;
+
+static void ups_put(FILE *f, uint32_t *crc, const void *s, long n)
+{
+  fwrite(s, 1, n, f);
+  *crc = crc32_update(*crc, s, n);
+}
+
+static void ups_putv(FILE *f, uint32_t *crc, unsigned long v)
+{
+  for (;;) {
+    unsigned char x = v & 0x7f;
+    v >>= 7;
+    if (v == 0) {
+      x |= 0x80;
+      ups_put(f, crc, &x, 1);
+      break;
+    }
+    ups_put(f, crc, &x, 1);
+    v--;
+  }
+}
+
+static void ups_put32(FILE *f, uint32_t *crc, uint32_t v)
+{
+  unsigned char b[4] = { v, v >> 8, v >> 16, v >> 24 };
+  ups_put(f, crc, b, 4);
+}
+
+static uint32_t ups_get32(const unsigned char *s)
+{
+  return s[0] | s[1] << 8 | s[2] << 16 | (uint32_t)s[3] << 24;
+}
+
+static int ups_getv(const unsigned char *s, long len, long *p,
+  unsigned long *v)
+{
+  unsigned long shift = 1;
+
+  *v = 0;
+  while (*p < len) {
+    unsigned char x = s[(*p)++];
+    *v += (x & 0x7f) * shift;
+    if (x & 0x80) return 0;
+    shift <<= 7;
+    *v += shift;
+  }
+  return -1;
+}
+
+/* checksums of the file before the session (`orig` holds the original
+   bytes, sorted) and as it is now, reading a window at a time */
+static int ups_crcs(edit *e, editlog *orig, long n, uint32_t *src,
+  uint32_t *dst)
+{
+  unsigned char *buf = malloc(UPS_WINDOW);
+  long k = 0;
+
+  if (buf == NULL) return -1;
+  *src = *dst = 0;
+  for (long off = 0; off < e->size; off += UPS_WINDOW) {
+    long len = (e->size - off < UPS_WINDOW ? e->size - off : UPS_WINDOW);
+    if (edit_read(e, off, buf, len) == -1) { free(buf); return -1; }
+    *dst = crc32_update(*dst, buf, len);
+    for (; k < n && orig[k].off < off + len; k++)
+      buf[orig[k].off - off] = orig[k].old;
+    *src = crc32_update(*src, buf, len);
+  }
+  free(buf);
+  return 0;
+}
+
+/* the journal of `e` as an UPS patch, returns the amount of changed bytes
+   or -1 with errno set */
+static long ups_export(edit *e, const char *path)
+{
+  editlog *orig;
+  long n, changed = 0, rel = 0;
+  uint32_t src, dst, crc = 0;
+  unsigned char cur;
+  FILE *f;
+
+  if ((orig = edit_originals(e, &n)) == NULL) return -1;
+  if (ups_crcs(e, orig, n, &src, &dst) == -1 ||
+      (f = fopen(path, "wb")) == NULL) {
+    free(orig);
+    return -1;
+  }
+
+  ups_put(f, &crc, "UPS1", 4);
+  ups_putv(f, &crc, e->size);
+  ups_putv(f, &crc, e->size);
+  for (long i = 0; i < n; ) {
+    long p = orig[i].off;
+    edit_read(e, p, &cur, 1);
+    if (cur == orig[i].old) { i++; continue; }
+
+    // a run of changed bytes, the zero that ends it takes a position too
+    ups_putv(f, &crc, p - rel);
+    while (i < n && orig[i].off == p) {
+      unsigned char x;
+      edit_read(e, p, &cur, 1);
+      if ((x = cur ^ orig[i].old) == 0) break;
+      ups_put(f, &crc, &x, 1);
+      changed++; p++; i++;
+    }
+    ups_put(f, &crc, "", 1);
+    rel = p + 1;
+  }
+  ups_put32(f, &crc, src);
+  ups_put32(f, &crc, dst);
+  ups_put32(f, &crc, crc);
+  free(orig);
+  if (fclose(f) == EOF) return -1;
+  return changed;
+}
+
+/* checks both checksums in one pass over the file, then writes the hunks.
+   Returns one of UPS_* */
+static int ups_apply(int fd, const char *path)
+{
+  unsigned char *patch = NULL, *buf = NULL;
+  upshunk *hunk = NULL;
+  long len, p = 4, nhunk = 0, cap = 0;
+  unsigned long ssize, tsize, rel = 0;
+  uint32_t src = 0, dst = 0;
+  struct stat st;
+  int r = UPS_BADPATCH;
+  FILE *f;
+  edit e = { .fd = fd };
+
+  if ((f = fopen(path, "rb")) == NULL) return UPS_IO;
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  rewind(f);
+  if (len < 16 || (patch = malloc(len)) == NULL ||
+      fread(patch, 1, len, f) != len) {
+    fclose(f);
+    free(patch);
+    return (len < 16 ? UPS_BADPATCH : UPS_IO);
+  }
+  fclose(f);
+
+  if (memcmp(patch, "UPS1", 4) != 0 ||
+      crc32_update(0, patch, len - 4) != ups_get32(patch + len - 4))
+    goto done;
+  if (ups_getv(patch, len - 12, &p, &ssize) == -1 ||
+      ups_getv(patch, len - 12, &p, &tsize) == -1)
+    goto done;
+  if (ssize != tsize) { r = UPS_SIZE; goto done; }
+  while (p < len - 12) {
+    unsigned long skip;
+    if (ups_getv(patch, len - 12, &p, &skip) == -1) goto done;
+    rel += skip;
+    if (nhunk == cap) {
+      upshunk *h = realloc(hunk, sizeof(upshunk) * (cap = cap*2 + 16));
+      if (h == NULL) { r = UPS_IO; goto done; }
+      hunk = h;
+    }
+    hunk[nhunk] = (upshunk){ rel, 0, patch + p };
+    while (p < len - 12 && patch[p] != 0) { p++; rel++; }
+    hunk[nhunk].len = patch + p - hunk[nhunk].xor;
+    if (rel > tsize) goto done;
+    nhunk++; p++; rel++;
+  }
+
+  r = UPS_IO;
+  if (fstat(fd, &st) == -1 || (buf = malloc(UPS_WINDOW)) == NULL) goto done;
+  if (st.st_size != ssize) { r = UPS_BADSOURCE; goto done; }
+  e.size = st.st_size;
+
+  for (long off = 0, h = 0; off < e.size; off += UPS_WINDOW) {
+    long n = (e.size - off < UPS_WINDOW ? e.size - off : UPS_WINDOW);
+    if (edit_read(&e, off, buf, n) == -1) goto done;
+    src = crc32_update(src, buf, n);
+    for (; h < nhunk && hunk[h].off < off + n; h++) {
+      long a = (hunk[h].off > off ? hunk[h].off : off),
+           b = hunk[h].off + hunk[h].len;
+      for (long i = a; i < b && i < off + n; i++)
+        buf[i - off] ^= hunk[h].xor[i - hunk[h].off];
+      if (b > off + n) break; // goes on in the next window
+    }
+    dst = crc32_update(dst, buf, n);
+  }
+  if (src != ups_get32(patch + len - 12)) {
+    r = (src == ups_get32(patch + len - 8) ? UPS_ALREADY : UPS_BADSOURCE);
+    goto done;
+  }
+  if (dst != ups_get32(patch + len - 8)) { r = UPS_BADPATCH; goto done; }
+
+  for (long h = 0; h < nhunk; h++) {
+    unsigned char tmp[4096];
+    for (long i = 0; i < hunk[h].len; i += sizeof(tmp)) {
+      long k = hunk[h].len - i;
+      if (k > sizeof(tmp)) k = sizeof(tmp);
+      if (edit_read(&e, hunk[h].off + i, tmp, k) == -1) goto done;
+      for (long j = 0; j < k; j++)
+        tmp[j] ^= hunk[h].xor[i + j];
+      if (edit_write(&e, hunk[h].off + i, tmp, k) == -1) goto done;
+    }
+  }
+  r = UPS_OK;
+
+done:
+  free(patch); free(buf); free(hunk);
+  return r;
+}
@@ -0,0 +1,166 @@
+// virtual addresses of ELF executables, core dumps and Mach-O files. The
+// segments that have bytes in the file are read once and kept sorted by
+// address and by file offset, both ways of translating are a binary search.
+typedef struct vseg {
+  unsigned long va;
+  long off, size;  // in the file
+} vseg;
+
+static struct {
+  vseg *byva, *byoff;
+  int   n;
+} va;
+
+static int va_cmpva(const void *a, const void *b)
+{
+  const vseg *x = a, *y = b;
+  return (x->va > y->va) - (x->va < y->va);
+}
+
+static int va_cmpoff(const void *a, const void *b)
+{
+  const vseg *x = a, *y = b;
+  return (x->off > y->off) - (x->off < y->off);
+}
+
+static unsigned long va_get(const unsigned char *m, long size, long off,
+  int n, int be)
+{
+  unsigned long v = 0;
+
+  if (off < 0 || off + n > size) return 0;
+  for (int i = 0; i < n; i++)
+    v |= (unsigned long)m[off + i] << 8*(be ? n-1-i : i);
+  return v;
+}
+
+static void va_add(unsigned long addr, long off, long size, long fsize)
+{
+  vseg *s;
+
+  if (size <= 0 || off < 0 || off >= fsize) return;
+  if (off + size > fsize) size = fsize - off;
+  if ((s = realloc(va.byva, sizeof(vseg) * (va.n + 1))) == NULL) return;
+  va.byva = s;
+  va.byva[va.n++] = (vseg){ addr, off, size };
+}
+
+/* sorts what va_add() got both ways, returns the amount of segments */
+static int va_index(void)
+{
+  if (va.n == 0) return 0;
+  free(va.byoff);
+  if ((va.byoff = malloc(sizeof(vseg) * va.n)) == NULL) return va.n = 0;
+  qsort(va.byva, va.n, sizeof(vseg), va_cmpva);
+  memcpy(va.byoff, va.byva, sizeof(vseg) * va.n);
+  qsort(va.byoff, va.n, sizeof(vseg), va_cmpoff);
+  return va.n;
+}
+
+/* PT_LOAD or LC_SEGMENT(_64) entries, returns the amount found */
+static int va_open(const char *mem, long size)
+{
+  const unsigned char *m = (const unsigned char *)mem;
+
+  va.n = 0;
+  if (size >= 52 && memcmp(m, "\x7f""ELF", 4) == 0) {
+    int is64 = (m[4] == 2), be = (m[5] == 2);
+    long phoff = va_get(m, size, is64 ? 32 : 28, is64 ? 8 : 4, be),
+         phentsize = va_get(m, size, is64 ? 54 : 42, 2, be),
+         phnum = va_get(m, size, is64 ? 56 : 44, 2, be);
+    for (long i = 0; i < phnum && phentsize > 0; i++) {
+      long p = phoff + i*phentsize;
+      if (va_get(m, size, p, 4, be) != 1) continue; // PT_LOAD
+      if (is64)
+        va_add(va_get(m, size, p + 16, 8, be), va_get(m, size, p + 8, 8, be),
+          va_get(m, size, p + 32, 8, be), size);
+      else
+        va_add(va_get(m, size, p + 8, 4, be), va_get(m, size, p + 4, 4, be),
+          va_get(m, size, p + 16, 4, be), size);
+    }
+  } else if (size >= 28 && (memcmp(m, "\xCF\xFA\xED\xFE", 4) == 0 ||
+      memcmp(m, "\xCE\xFA\xED\xFE", 4) == 0 ||
+      memcmp(m, "\xFE\xED\xFA\xCF", 4) == 0 ||
+      memcmp(m, "\xFE\xED\xFA\xCE", 4) == 0)) { // fat binaries aren't
+    int be = (m[0] == 0xFE), is64 = (m[be ? 3 : 0] == 0xCF);
+    long ncmds = va_get(m, size, 16, 4, be), p = (is64 ? 32 : 28);
+    for (long i = 0; i < ncmds && p + 8 <= size; i++) {
+      unsigned long cmd = va_get(m, size, p, 4, be),
+                    cmdsize = va_get(m, size, p + 4, 4, be);
+      if (cmd == 0x19) // LC_SEGMENT_64
+        va_add(va_get(m, size, p + 24, 8, be), va_get(m, size, p + 40, 8, be),
+          va_get(m, size, p + 48, 8, be), size);
+      else if (cmd == 0x1) // LC_SEGMENT
+        va_add(va_get(m, size, p + 24, 4, be), va_get(m, size, p + 32, 4, be),
+          va_get(m, size, p + 36, 4, be), size);
+      if (cmdsize < 8) break;
+      p += cmdsize;
+    }
+  }
+  return va_index();
+}
+
+/* index of the last segment starting at or before `x` in `s`, -1 if none */
+static int va_last(vseg *s, unsigned long x, int byva)
+{
+  int lo = 0, hi = va.n;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if ((byva ? s[mid].va : (unsigned long)s[mid].off) <= x)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo - 1;
+}
+
+/* file offset of an address, -1 when it has no bytes in the file */
+static long va_to_off(unsigned long addr)
+{
+  int i = va_last(va.byva, addr, 1);
+
+  if (i == -1 || addr - va.byva[i].va >= va.byva[i].size) return -1;
+  return va.byva[i].off + (addr - va.byva[i].va);
+}
+
+/* address of a file offset, 0 with *ok unset when it's not mapped */
+static unsigned long va_from_off(long off, int *ok)
+{
+  int i = va_last(va.byoff, off, 0);
+
+  while (i >= 0 && off - va.byoff[i].off >= va.byoff[i].size)
+    i--; // segments may overlap, one starting before may still cover it
+  *ok = (i != -1);
+  return (*ok ? va.byoff[i].va + (off - va.byoff[i].off) : 0);
+}
+
+static int va_mapped(long off, long len) /* any of [off, off+len) */
+{
+  // every segment starting in the range or before it, they may overlap
+  for (int i = va_last(va.byoff, off + len - 1, 0); i >= 0; i--)
+    if (va.byoff[i].off + va.byoff[i].size > off) return 1;
+  return 0;
+}
+
+/* hex digits of the highest address: 8, or 16 past 32 bits */
+static int va_digits(void)
+{
+  for (int i = 0; i < va.n; i++)
+    if (va.byva[i].va + va.byva[i].size - 1 > 0xffffffffUL) return 16;
+  return 8;
+}
+
+/* the first mapped offset after `off`, or the last one before it, -1 if
+   there's none */
+static long va_skip(long off, int dir)
+{
+  int i = va_last(va.byoff, off, 0);
+
+  if (dir > 0)
+    return (i + 1 < va.n ? va.byoff[i + 1].off : -1);
+  for (; i >= 0; i--)
+    if (va.byoff[i].off + va.byoff[i].size <= off)
+      return va.byoff[i].off + va.byoff[i].size - 1;
+  return -1;
+}
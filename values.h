@@ -0,0 +1,456 @@
+// typed value search: a number, a range or a float to some precision is
+// looked for the ways it can be stored, 8 to 64 bit integers (signed or
+// not) and IEEE floats, either byte order. Each encoding is a range or two
+// of bit patterns (floats too, as their patterns sort like them), and the
+// byte of it the fewest values share is its key: keys are tested 16
+// offsets at a time with SSE2, only the offsets that pass are read whole.
+// All encodings go over a block of 64 offsets while it's in cache, so the
+// file is read once whatever the number of encodings.
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#define VAL_CHUNK (4L << 20)
+#define VAL_ENC   16
+
+typedef struct valenc {
+  int      width, be, fl;  // bytes, big endian, IEEE float
+  int      narc, key;      // key: its byte from the start of the value
+  uint64_t a[2], d[2];     // the patterns x with (x - a) % 2^bits <= d
+  unsigned char kb[2], kd[2];  // the same for the key byte
+} valenc;
+
+typedef struct valjob {
+  job    j;
+  const unsigned char *mem;
+  long   size, start;
+  valenc enc[VAL_ENC];
+  int    nenc, zeros;  // zeros: the narrowest encoding 0 is a value of
+  int64_t lo, hi;      // of the integers
+  long   best;         // lowest offset with a value, LONG_MAX for none
+} valjob;
+
+/* the number in [s, e): integers (0x for hex, wrapping past 2^63) in *i,
+   floats in *f with half a unit of their last digit in *ulp. 1 for a
+   float, 0 an integer, -1 not a number */
+static int val_num(const char *s, const char *e, int64_t *i, double *f,
+  double *ulp)
+{
+  char buf[64], *p, *end;
+  int  n = e - s, neg, base = 10, exp = 0, fl;
+  uint64_t u;
+
+  if (n <= 0 || n >= sizeof(buf)) return -1;
+  memcpy(buf, s, n);
+  buf[n] = '\0';
+  neg = (buf[0] == '-');
+  p   = buf + (buf[0] == '-' || buf[0] == '+');
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    base = 16;
+    p += 2;
+  }
+  if (!isxdigit((unsigned char)*p) && *p != '.') return -1;
+  errno = 0;
+  if ((fl = (base == 10 && strpbrk(p, ".eE") != NULL))) {
+    *f = strtod(buf, &end);
+    *ulp = 0.5;
+    if ((p = strpbrk(buf, "eE")) != NULL) exp = atoi(p + 1);
+    if ((p = strchr(buf, '.')) != NULL)
+      while (isdigit((unsigned char)*++p)) exp--;
+    for (; exp > 0 && exp < 400; exp--) *ulp *= 10;
+    for (; exp < 0 && exp > -400; exp++) *ulp /= 10;
+    *i = 0;
+  } else {
+    u  = strtoull(p, &end, base);
+    *i = (int64_t)(neg ? 0 - u : u);
+    *f = (double)*i;
+    *ulp = 0;
+  }
+  return (*end != '\0' || errno != 0 ? -1 : fl);
+}
+
+static int64_t val_int(double d, int up) /* ceil or floor, saturated */
+{
+  int64_t i;
+
+  if (d <= -9.2e18) return INT64_MIN;
+  if (d >= 9.2e18) return INT64_MAX;
+  i = (int64_t)d;
+  if (up && (double)i < d) i++;
+  if (!up && (double)i > d) i--;
+  return i;
+}
+
+static void val_arc(valenc *e, uint64_t a, uint64_t d)
+{
+  for (int k = 0; k < e->narc; k++)
+    if (e->a[k] == a && e->d[k] == d) return;
+  e->a[e->narc] = a;
+  e->d[e->narc++] = d;
+}
+
+/* the pattern of the float nearest to x >= 0, not below x when up, not
+   above it otherwise */
+static uint64_t val_fbits(double x, int width, int up)
+{
+  uint64_t b;
+  uint32_t u;
+  float    f = x;
+
+  if (width == 8) {
+    memcpy(&b, &x, 8);
+    return b;
+  }
+  memcpy(&u, &f, 4);
+  if (up && f < x) u++;
+  if (!up && f > x) u--;
+  return u;
+}
+
+static void val_farcs(valenc *e, double lo, double hi) /* [lo, hi] */
+{
+  uint64_t sign = (uint64_t)1 << (8*e->width - 1), a, b;
+
+  if (hi >= 0) { // +0 up
+    a = val_fbits(lo > 0 ? lo : 0, e->width, 1);
+    b = val_fbits(hi, e->width, 0);
+    if (a <= b) val_arc(e, a, b - a);
+  }
+  if (lo <= 0) { // -0 down, by magnitude (0 - 0.0 is +0)
+    a = val_fbits(hi < 0 ? 0 - hi : 0, e->width, 1);
+    b = val_fbits(0 - lo, e->width, 0);
+    if (a <= b) val_arc(e, sign | a, b - a);
+  }
+}
+
+/* the key: what the patterns have at each byte is a range (wrapping) of
+   d/2^s + 1 or 2 values; the fewest wins, 0 and 0xFF (all over binaries)
+   last */
+static void val_key(valenc *e)
+{
+  int best = INT_MAX;
+
+  for (int j = 0; j < e->width; j++) { // by significance
+    int s = 8*j, score = 0;
+    uint64_t low = ((uint64_t)1 << s) - 1, n = 0;
+    unsigned char kb[2] = { 0 }, kd[2] = { 0 };
+    for (int k = 0; k < e->narc && n < 255; k++) {
+      n = (e->d[k] >> s) + (((e->d[k] & low) + (e->a[k] & low)) >> s);
+      kb[k] = e->a[k] >> s;
+      kd[k] = (n < 255 ? n : 255);
+      score += n + 1 + 64*((unsigned char)(0 - kb[k]) <= kd[k]) +
+        32*((unsigned char)(0xff - kb[k]) <= kd[k]);
+    }
+    if (n < 255 && score < best) {
+      best   = score;
+      e->key = (e->be ? e->width - 1 - j : j);
+      memcpy(e->kb, kb, sizeof(kb));
+      memcpy(e->kd, kd, sizeof(kd));
+    }
+  }
+  if (best == INT_MAX) { // any byte: one range of all of them
+    e->key   = 0;
+    e->kb[0] = e->kb[1] = 0;
+    e->kd[0] = e->kd[1] = 255;
+  }
+}
+
+static void val_add(valjob *v, valenc e, int orders)
+{
+  for (int be = 0; be < 2; be++)
+    if (orders & 1 << be && v->nenc < VAL_ENC) {
+      e.be = be;
+      val_key(&e);
+      v->enc[v->nenc++] = e;
+      if (e.width == 1) return; // one byte has no order
+    }
+}
+
+/* [s, e) has a in it */
+static const char *val_strstr(const char *s, const char *e, const char *a)
+{
+  for (int n = strlen(a); e - s >= n; s++)
+    if (memcmp(s, a, n) == 0) return s;
+  return NULL;
+}
+
+/* the query: `n`, `lo..hi` or `n~tolerance`, then optionally what it's
+   stored as: 8 16 32 64 for the bits, le or be, i or f. Floats (with a dot
+   or an exponent) are taken to the precision they're written in. NULL
+   when the encodings are set, or what's wrong */
+static const char *val_parse(valjob *v, const char *s, int len)
+{
+  const char *e = s + len, *t, *sep;
+  int64_t i0, i1, lo, hi;
+  double  f0, f1, u0, u1, flo, fhi;
+  int     fl, fl1 = 0, widths = 0, orders = 0, kinds = 0;
+
+  while (s < e && *s == ' ') s++;
+  for (t = s; t < e && *t != ' '; t++)
+    ;
+  if ((sep = val_strstr(s, t, "..")) != NULL) {
+    fl  = val_num(s, sep, &i0, &f0, &u0);
+    fl1 = val_num(sep + 2, t, &i1, &f1, &u1);
+    if (fl == -1 || fl1 == -1) return "not a number";
+    lo  = (i0 < i1 ? i0 : i1);
+    hi  = (i0 < i1 ? i1 : i0);
+    flo = (f0 < f1 ? f0 : f1);
+    fhi = (f0 < f1 ? f1 : f0);
+  } else if ((sep = val_strstr(s, t, "~")) != NULL) {
+    fl  = val_num(s, sep, &i0, &f0, &u0);
+    fl1 = val_num(sep + 1, t, &i1, &f1, &u1);
+    if (fl == -1 || fl1 == -1) return "not a number";
+    if (f1 < 0) return "negative tolerance";
+    if (__builtin_sub_overflow(i0, i1, &lo)) lo = INT64_MIN;
+    if (__builtin_add_overflow(i0, i1, &hi)) hi = INT64_MAX;
+    flo = f0 - f1;
+    fhi = f0 + f1;
+  } else {
+    if ((fl = val_num(s, t, &i0, &f0, &u0)) == -1) return "not a number";
+    lo  = hi = i0;
+    flo = f0 - u0;
+    fhi = f0 + u0;
+  }
+  fl |= fl1;
+  for (s = t; s < e; s = t) { // what it's stored as
+    while (s < e && *s == ' ') s++;
+    for (t = s; t < e && *t != ' '; t++)
+      ;
+    if (t - s == 1 && *s == '8') widths |= 1;
+    else if (t - s == 2 && memcmp(s, "16", 2) == 0) widths |= 2;
+    else if (t - s == 2 && memcmp(s, "32", 2) == 0) widths |= 4;
+    else if (t - s == 2 && memcmp(s, "64", 2) == 0) widths |= 8;
+    else if (t - s == 2 && memcmp(s, "le", 2) == 0) orders |= 1;
+    else if (t - s == 2 && memcmp(s, "be", 2) == 0) orders |= 2;
+    else if (t - s == 1 && *s == 'i') kinds |= 1;
+    else if (t - s == 1 && *s == 'f') kinds |= 2;
+    else if (t > s) return "unknown type";
+  }
+  if (widths == 0) widths = 1|2|4|8;
+  if (orders == 0) orders = 1|2;
+  if (kinds == 0)  kinds  = (fl ? 2 : 1);
+  if (fl) { // the integers it spans
+    lo = val_int(flo, 1);
+    hi = val_int(fhi, 0);
+  }
+  v->lo = lo;
+  v->hi = hi;
+  v->nenc = 0;
+  for (int w = 1; w <= 8 && kinds & 1 && lo <= hi; w *= 2) {
+    valenc n = { .width = w };
+    if (!(widths & w)) continue;
+    if (w == 8) {
+      val_arc(&n, (uint64_t)lo, (uint64_t)hi - (uint64_t)lo);
+    } else {
+      int64_t umax = ((int64_t)1 << 8*w) - 1, smax = umax >> 1,
+              a = (lo > 0 ? lo : 0), b = (hi < umax ? hi : umax);
+      if (a <= b) val_arc(&n, a, b - a);
+      a = (lo > -smax - 1 ? lo : -smax - 1);
+      b = (hi < smax ? hi : smax);
+      if (a <= b) val_arc(&n, (uint64_t)a & umax, b - a);
+    }
+    if (n.narc > 0) val_add(v, n, orders);
+  }
+  for (int w = 4; w <= 8 && kinds & 2 && flo <= fhi; w *= 2) {
+    valenc n = { .width = w, .fl = 1 };
+    if (!(widths & w)) continue;
+    val_farcs(&n, flo, fhi);
+    if (n.narc > 0) val_add(v, n, orders);
+  }
+  return (v->nenc > 0 ? NULL : "no encoding holds it");
+}
+
+static uint64_t val_load(const valenc *e, const unsigned char *p)
+{
+  uint64_t x = 0;
+
+  for (int i = 0; i < e->width; i++)
+    x |= (uint64_t)p[e->be ? e->width - 1 - i : i] << 8*i;
+  return x;
+}
+
+/* p is a value of the encoding */
+static int val_at(const valenc *e, const unsigned char *p)
+{
+  uint64_t x = val_load(e, p), m = (e->width == 8 ? ~(uint64_t)0 :
+    ((uint64_t)1 << 8*e->width) - 1);
+
+  for (int k = 0; k < e->narc; k++)
+    if (((x - e->a[k]) & m) <= e->d[k]) return 1;
+  return 0;
+}
+
+static int val_key_at(const valenc *e, const unsigned char *p)
+{
+  unsigned char c = p[e->key];
+
+  for (int k = 0; k < e->narc; k++)
+    if ((unsigned char)(c - e->kb[k]) <= e->kd[k]) return 1;
+  return 0;
+}
+
+/* a bit for each of the 64 offsets from p that's a value of an encoding,
+   one offset at a time; n is how many bytes there are from p on */
+static uint64_t val_block_scalar(const valjob *v, const unsigned char *p,
+  long n)
+{
+  uint64_t m = 0;
+
+  for (int k = 0; k < v->nenc; k++)
+    for (int i = 0; i < 64 && i + v->enc[k].width <= n; i++)
+      if (val_key_at(&v->enc[k], p + i) && val_at(&v->enc[k], p + i))
+        m |= (uint64_t)1 << i;
+  return m;
+}
+
+/* val_block_scalar() with the keys of 16 offsets at once */
+static uint64_t val_block(const valjob *v, const unsigned char *p, long n)
+{
+#ifdef __SSE2__
+  uint64_t m = 0;
+
+  if (n < 64 + 16) return val_block_scalar(v, p, n);
+  for (int k = 0; k < v->nenc; k++) {
+    const valenc *e = &v->enc[k];
+    __m128i b0 = _mm_set1_epi8((char)e->kb[0]),
+            d0 = _mm_set1_epi8((char)e->kd[0]),
+            b1 = _mm_set1_epi8((char)e->kb[e->narc - 1]),
+            d1 = _mm_set1_epi8((char)e->kd[e->narc - 1]);
+    uint64_t c = 0;
+    for (int i = 0; i < 64; i += 16) { // c - b <= d, unsigned
+      __m128i x  = _mm_loadu_si128((const __m128i *)(p + i + e->key)),
+              t0 = _mm_sub_epi8(x, b0), t1 = _mm_sub_epi8(x, b1);
+      c |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(_mm_min_epu8(t0, d0), t0),
+        _mm_cmpeq_epi8(_mm_min_epu8(t1, d1), t1))) << i;
+    }
+    for (c &= ~m; c != 0; c &= c - 1) {
+      int i = __builtin_ctzll(c);
+      if (val_at(e, p + i)) m |= (uint64_t)1 << i;
+    }
+  }
+  return m;
+#else
+  return val_block_scalar(v, p, n);
+#endif
+}
+
+static void val_better(valjob *v, long at)
+{
+  long best = __atomic_load_n(&v->best, __ATOMIC_RELAXED);
+
+  while (at < best &&
+    !__atomic_compare_exchange_n(&v->best, &best, at, 0,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/* the first offset of [from, to) with a value, -1 for none */
+static long val_range(valjob *v, long from, long to)
+{
+  for (long p = from; p < to; p += 64) {
+    uint64_t m;
+    if ((p - from) % (1L << 20) == 0 &&
+        (p >= __atomic_load_n(&v->best, __ATOMIC_RELAXED) ||
+         job_cancelled(&v->j)))
+      return -1;
+    m = val_block(v, v->mem + p, v->size - p);
+    if (to - p < 64) m &= ((uint64_t)1 << (to - p)) - 1;
+    if (m != 0) return p + __builtin_ctzll(m);
+  }
+  return -1;
+}
+
+static void val_chunk(job *j, long chunk)
+{
+  valjob *v = (valjob *)j;
+  long off = v->start + chunk*VAL_CHUNK, end, reach, a, b, at;
+
+  if (off >= __atomic_load_n(&v->best, __ATOMIC_RELAXED)) return;
+  end   = (v->size - off < VAL_CHUNK ? v->size : off + VAL_CHUNK);
+  reach = (v->size - end < 7 ? v->size : end + 7);
+  for (a = off; (a = ext_data(a, reach, &b)) != -1; a = b) {
+    // values of a hole that reach into the data are read too
+    long from = (a - off < 7 ? off : a - 7), to = (b < end ? b : end);
+    if (from >= __atomic_load_n(&v->best, __ATOMIC_RELAXED)) break;
+    if ((at = val_range(v, from, to)) != -1) {
+      val_better(v, at);
+      break;
+    }
+  }
+  if (!v->zeros) return;
+  for (long h = off, e; h < end; h = e) { // a hole long enough is one too
+    if (ext_hole(h, &e)) {
+      if (e - h >= v->zeros) {
+        val_better(v, h);
+        return;
+      }
+    } else if (ext_data(h, end, &e) == -1) {
+      return;
+    }
+  }
+}
+
+/* the value at `at` as the first encoding it is, e.g. "u32le 128000"; its
+   width, 0 when it's none */
+static int val_name(const valjob *v, long at, char *s, int n)
+{
+  for (int k = 0; k < v->nenc; k++) {
+    const valenc *e = &v->enc[k];
+    const char *order = (e->width == 1 ? "" : e->be ? "be" : "le");
+    uint64_t x;
+    int64_t  i;
+    if (at + e->width > v->size || !val_at(e, v->mem + at)) continue;
+    x = val_load(e, v->mem + at);
+    if (e->fl && e->width == 4) {
+      uint32_t u = x;
+      float f;
+      memcpy(&f, &u, 4);
+      snprintf(s, n, "f32%s %g", order, f);
+    } else if (e->fl) {
+      double d;
+      memcpy(&d, &x, 8);
+      snprintf(s, n, "f64%s %g", order, d);
+    } else {
+      i = (int64_t)x;
+      if (e->width < 8 && (i < v->lo || i > v->hi)) // it's the signed one
+        i = (int64_t)(x << (64 - 8*e->width)) >> (64 - 8*e->width);
+      snprintf(s, n, "%c%d%s %lld", (i >= 0 ? 'u' : 'i'), 8*e->width,
+        order, (long long)i);
+    }
+    return e->width;
+  }
+  return 0;
+}
+
+/* NULL with *err set when the query doesn't parse, NULL too if there's
+   nothing after start; `deliver` gets the result */
+static valjob *val_new(const unsigned char *mem, long size, long start,
+  const char *q, int len, const char **err, void (*deliver)(job *))
+{
+  unsigned char zero[8] = { 0 };
+  valjob *v;
+
+  *err = NULL;
+  if ((v = calloc(1, sizeof(valjob))) == NULL) return NULL;
+  if ((*err = val_parse(v, q, len)) != NULL || start < 0 || start >= size) {
+    free(v);
+    return NULL;
+  }
+  v->j = (job){
+    .name = "value",
+    .nchunks = (size - start + VAL_CHUNK - 1) / VAL_CHUNK,
+    .run = val_chunk,
+    .deliver = deliver
+  };
+  v->mem   = mem;
+  v->size  = size;
+  v->start = start;
+  v->best  = LONG_MAX;
+  for (int k = 0; k < v->nenc; k++)
+    if (val_at(&v->enc[k], zero) &&
+        (v->zeros == 0 || v->enc[k].width < v->zeros))
+      v->zeros = v->enc[k].width;
+  return v;
+}